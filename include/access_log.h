@@ -0,0 +1,52 @@
+#ifndef OPTIFT_ACCESS_LOG_H
+#define OPTIFT_ACCESS_LOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <istream>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace optift {
+
+struct AccessLogOptions {
+    // Matched against the path of each request. The first capture group, or
+    // the whole match if there is none, is the key of the post in the input.
+    // Requests that do not match are not page views and are ignored.
+    std::regex post_pattern{"^[^?#]*"};
+    // A visitor that makes no request for this long starts a new session
+    std::chrono::seconds session_timeout = std::chrono::minutes{30};
+};
+
+/// Distinct set of posts viewed in a session, and how many sessions viewed
+/// exactly these posts.
+struct Session {
+    // Sorted post keys, without duplicates
+    std::vector<std::string> posts;
+    double count;
+};
+
+/**
+ * Reconstructs browsing sessions from an access log in the nginx combined
+ * format, which is also Apache's:
+ *
+ *   addr - user [10/Oct/2000:13:55:36 -0700] "GET /path HTTP/1.1" 200 123
+ *   "referer" "user agent"
+ *
+ * The log is streamed, and only the sessions still open are kept in memory,
+ * so lines should be roughly in chronological order. A visitor is identified
+ * by address and user agent. Only successful GET requests (status 2xx or 304)
+ * are page views. Malformed lines are skipped and counted in the log.
+ *
+ * \param in The log
+ * \param options How to map requests to posts and when sessions end
+ * \return Sessions that viewed at least one post, with identical sets of posts
+ *   merged, in no particular order
+ */
+std::vector<Session> read_access_log_sessions(std::istream &in,
+                                              const AccessLogOptions &options);
+
+} // namespace optift
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef OPTIFT_COST_CACHE_H
+#define OPTIFT_COST_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <unicode/umachine.h>
+
+namespace optift {
+
+/// Returns the XXH3 hash of some data.
+uint64_t hash_bytes(std::span<const uint8_t> data);
+
+/**
+ * Persistent samples of the cost model of a font, i.e. the sizes of subsets of
+ * its codepoint universe, so that later runs and interrupted ones reuse them.
+ *
+ * The samples of a font are kept in files named after the hash of the font
+ * data. Each starts with a versioned header with the codepoint universe that
+ * its samples were drawn from, followed by one fixed-size record per sample,
+ * which are appended as samples are taken. Since the sizes of subsets of
+ * similar universes are the same, a file is reused as long as its universe is
+ * similar enough to the current one, so adding a page to a site does not
+ * discard the samples.
+ */
+class CostModelCache {
+  public:
+    // Files whose universe has at least this Jaccard similarity to the
+    // current one are reused
+    static constexpr double MIN_SIMILARITY = 0.95;
+
+    /**
+     * Opens the file of the given font in a directory whose universe is the
+     * most similar to the given one, or creates one. Files that are not valid
+     * cache files of this version are ignored.
+     *
+     * \param dir The cache directory, which is created if needed
+     * \param font_data The data of the font file
+     * \param codepoints The sorted codepoint universe
+     * \throw std::runtime_error If the cache file cannot be opened
+     */
+    CostModelCache(const std::filesystem::path &dir,
+                   std::span<const uint8_t> font_data,
+                   std::span<const UChar32> codepoints);
+
+    /// Samples read from the file, as pairs of subset size and bytes.
+    const std::vector<std::pair<size_t, double>> &samples() const {
+        return loaded_samples;
+    }
+
+    const std::filesystem::path &path() const { return file_path; }
+
+    /// Appends a sample to the file and flushes it. Not thread-safe.
+    void append(size_t n_glyphs, double bytes);
+
+  private:
+    std::filesystem::path file_path;
+    std::ofstream file;
+    std::vector<std::pair<size_t, double>> loaded_samples;
+};
+
+} // namespace optift
+
+#endif
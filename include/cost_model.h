@@ -2,7 +2,9 @@
 #define OPTIFT_COST_MODEL_H
 
 #include <cstddef>
+#include <functional>
 #include <span>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -38,6 +40,66 @@ class FontEmpiricalCostModel : public FontCostModel {
     std::vector<std::pair<size_t, double>> data;
 };
 
+/**
+ * Round-trip time and bandwidth of the network that pages are loaded over.
+ * Each font request costs the page at least one round trip on top of its
+ * bytes, which converts to the bytes that could have been downloaded in that
+ * time.
+ */
+struct NetworkProfile {
+    double rtt_seconds = 0.0;
+    double bytes_per_second = 0.0;
+
+    /// Returns the latency of a request in byte equivalents.
+    double request_cost() const { return rtt_seconds * bytes_per_second; }
+
+    /**
+     * Returns a named profile: none (no latency) or the 3g, 4g and cable
+     * profiles of WebPageTest.
+     *
+     * \throw std::runtime_error If the name is unknown
+     */
+    static NetworkProfile from_name(std::string_view name);
+};
+
+/**
+ * Adds a fixed cost to every font request of a cost model, such as the
+ * latency from \ref NetworkProfile::request_cost, so that the solvers weigh
+ * fewer requests per page against fewer bytes.
+ */
+class FontLatencyCostModel final : public FontCostModel {
+  public:
+    FontLatencyCostModel(std::function<double(size_t)> model,
+                         double request_cost)
+        : model{std::move(model)}, request_cost{request_cost} {}
+
+    double operator()(size_t n_glyphs) const override {
+        return model(n_glyphs) + request_cost;
+    }
+
+  private:
+    std::function<double(size_t)> model;
+    double request_cost;
+};
+
+/**
+ * A cost model tabulated for every number of glyphs up to a maximum, so that
+ * evaluating it in the solvers is a single array lookup. Larger numbers of
+ * glyphs fall back to the original model.
+ */
+class TabulatedCostModel final : public FontCostModel {
+  public:
+    TabulatedCostModel(std::function<double(size_t)> model, size_t max_glyphs);
+
+    double operator()(size_t n_glyphs) const override {
+        return n_glyphs < table.size() ? table[n_glyphs] : model(n_glyphs);
+    }
+
+  private:
+    std::function<double(size_t)> model;
+    std::vector<double> table;
+};
+
 } // namespace optift
 
 #endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef OPTIFT_DYNAMIC_BITSET_H
+#define OPTIFT_DYNAMIC_BITSET_H
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace optift {
+
+/**
+ * Word-level kernels backing \ref DynamicBitSet. All spans passed to the same
+ * call must have the same length. None of these allocate; outputs are written
+ * to caller-provided buffers. The implementation (scalar, AVX2 or AVX-512) is
+ * chosen once at runtime based on what the CPU supports.
+ */
+namespace bitset_kernels {
+
+using Word = uint64_t;
+using Words = std::span<const Word>;
+using MutWords = std::span<Word>;
+
+/// Returns |a|
+size_t popcount(Words a);
+/// Returns |a & b|
+size_t and_popcount(Words a, Words b);
+/// Returns |a | b| without materializing the union
+size_t or_popcount(Words a, Words b);
+/// Returns whether a & b is empty
+bool is_disjoint(Words a, Words b);
+/// Computes out = a & b and returns |out|
+size_t and_into(Words a, Words b, MutWords out);
+/// Computes diff = a & ~b and inter = a & b, and returns |inter|
+size_t diff_and_into(Words a, Words b, MutWords diff, MutWords inter);
+/// Computes a &= ~b in place
+void andnot_inplace(MutWords a, Words b);
+/// Computes a |= b in place
+void or_inplace(MutWords a, Words b);
+
+/// Name of the implementation selected at runtime, for logging
+const char *implementation();
+
+} // namespace bitset_kernels
+
+struct DynamicBitSet {
+    using Element = bitset_kernels::Word;
+    constexpr static size_t ElementBits = sizeof(Element) * 8;
+
+    size_t n_items;
+    std::vector<Element> bits;
+
+    explicit DynamicBitSet(size_t n)
+        : n_items{n}, bits((n + ElementBits - 1) / ElementBits, 0) {}
+
+    template <std::ranges::input_range Container>
+    explicit DynamicBitSet(size_t n, const Container &c) : DynamicBitSet{n} {
+        for (size_t i : c) {
+            set(i);
+        }
+    }
+
+    size_t size() const { return bitset_kernels::popcount(bits); }
+
+    void set(size_t i) { bits[i / ElementBits] |= 1ULL << (i % ElementBits); }
+
+    void reset(size_t i) {
+        bits[i / ElementBits] &= ~(1ULL << (i % ElementBits));
+    }
+
+    bool test(size_t i) const {
+        return (bits[i / ElementBits] >> (i % ElementBits)) & 1ULL;
+    }
+
+    void clear() { std::ranges::fill(bits, 0); }
+
+    /**
+     * Writes the difference and the intersection with the other bitset into
+     * the given bitsets, which must have the same size as this one.
+     *
+     * \return The size of the intersection
+     */
+    size_t diff_intersect_into(const DynamicBitSet &other, DynamicBitSet &diff,
+                               DynamicBitSet &inter) const {
+        assert_same_size(other);
+        assert_same_size(diff);
+        assert_same_size(inter);
+        return bitset_kernels::diff_and_into(bits, other.bits, diff.bits,
+                                             inter.bits);
+    }
+
+    /**
+     * Writes the intersection with the other bitset into the given bitset,
+     * which must have the same size as this one.
+     *
+     * \return The size of the intersection
+     */
+    size_t intersect_into(const DynamicBitSet &other,
+                          DynamicBitSet &inter) const {
+        assert_same_size(other);
+        assert_same_size(inter);
+        return bitset_kernels::and_into(bits, other.bits, inter.bits);
+    }
+
+    size_t intersect_size(const DynamicBitSet &other) const {
+        assert_same_size(other);
+        return bitset_kernels::and_popcount(bits, other.bits);
+    }
+
+    size_t union_size(const DynamicBitSet &other) const {
+        assert_same_size(other);
+        return bitset_kernels::or_popcount(bits, other.bits);
+    }
+
+    /// Removes all items of the other bitset from this one.
+    void subtract(const DynamicBitSet &other) {
+        assert_same_size(other);
+        bitset_kernels::andnot_inplace(bits, other.bits);
+    }
+
+    /// Adds all items of the other bitset to this one.
+    void unite(const DynamicBitSet &other) {
+        assert_same_size(other);
+        bitset_kernels::or_inplace(bits, other.bits);
+    }
+
+    bool is_disjoint(const DynamicBitSet &other) const {
+        assert_same_size(other);
+        return bitset_kernels::is_disjoint(bits, other.bits);
+    }
+
+    /// Calls f with the index of every item in the set, in increasing order.
+    template <typename F> void for_each(F &&f) const {
+        for (size_t i = 0; i < bits.size(); i++) {
+            for (Element t = bits[i]; t; t &= t - 1) {
+                f(i * ElementBits + std::countr_zero(t));
+            }
+        }
+    }
+
+    std::unordered_set<size_t> to_set() const {
+        std::unordered_set<size_t> result;
+        for_each([&](size_t i) { result.insert(i); });
+        return result;
+    }
+
+  private:
+    void assert_same_size(const DynamicBitSet &other) const {
+        if (n_items != other.n_items) {
+            throw std::runtime_error{
+                fmt::format("bitsets have different sizes: {} and {}", n_items,
+                            other.n_items)};
+        }
+    }
+};
+
+} // namespace optift
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef OPTIFT_GLYPH_OUTLINES_H
+#define OPTIFT_GLYPH_OUTLINES_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <hb.h>
+#include <unicode/umachine.h>
+
+namespace optift {
+
+/**
+ * Reads the size in bytes of the outline of every glyph of a face from its
+ * tables: the length of its glyf entry from loca, plus the entries of its
+ * components for composite glyphs, or the length of its CFF charstring.
+ * Subroutines shared by CFF charstrings are not counted.
+ *
+ * \param face The font face
+ * \return The outline size of each glyph id
+ * \throw std::runtime_error If the face has neither glyf nor CFF outlines, or
+ *   its tables are malformed
+ */
+std::vector<size_t> read_glyph_outline_sizes(hb_face_t *face);
+
+/**
+ * Returns the outline size of the nominal glyph of each codepoint, see
+ * \ref read_glyph_outline_sizes. Codepoints that the face does not map to a
+ * glyph have size 0.
+ */
+std::vector<size_t>
+read_codepoint_outline_sizes(hb_face_t *face,
+                             std::span<const UChar32> codepoints);
+
+} // namespace optift
+
+#endif
@@ -45,6 +45,17 @@ class FacePtr : public std::unique_ptr<hb_face_t, decltype(&hb_face_destroy)> {
     }
 };
 
+class FontPtr : public std::unique_ptr<hb_font_t, decltype(&hb_font_destroy)> {
+  public:
+    explicit FontPtr(hb_font_t *font)
+        : std::unique_ptr<hb_font_t, decltype(&hb_font_destroy)>{
+              font, hb_font_destroy} {
+        if (this->get() == nullptr) {
+            throw std::runtime_error("failed to create font object");
+        }
+    }
+};
+
 } // namespace optift
 
 #endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+#ifndef OPTIFT_ITEM_MOVE_STATE_H
+#define OPTIFT_ITEM_MOVE_STATE_H
+
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <range/v3/numeric/accumulate.hpp>
+#include <range/v3/view/filter.hpp>
+
+#include "cost_model.h"
+#include "partitioner.h"
+
+namespace optift {
+
+/**
+ * Calls f with the cost model of the instance as a concrete type, so that the
+ * solvers can be instantiated without indirect calls in their inner loops. A
+ * linear model is passed as is, so that cost differences are computed in
+ * closed form. Any other model is tabulated up to the total size of all items.
+ */
+template <typename F>
+decltype(auto) visit_cost_model(const PartitionInstance &instance, F &&f) {
+    if (const auto *linear =
+            instance.cost_model.target<FontLinearCostModel>()) {
+        return f(*linear);
+    }
+    const TabulatedCostModel table{
+        instance.cost_model,
+        ranges::accumulate(instance.item_sizes, size_t(0))};
+    return f(table);
+}
+
+/// Returns cost(after) - cost(before), in closed form for the linear model.
+template <typename Cost>
+double cost_difference(const Cost &cost, size_t before, size_t after) {
+    if constexpr (std::is_same_v<Cost, FontLinearCostModel>) {
+        return cost.cost_per_glyph *
+               (static_cast<double>(after) - static_cast<double>(before));
+    } else {
+        return cost(after) - cost(before);
+    }
+}
+
+/**
+ * Incremental state for moving single items between partitions. For every item
+ * x we keep the weight of requests that would stop using the partition of x if
+ * x left it, and for every partition b the weight of requests containing x that
+ * do not use b yet. The cost delta of any single-item move is then O(1).
+ *
+ * \tparam Cost The type of the cost model, see \ref visit_cost_model
+ */
+template <typename Cost> struct ItemMoveState {
+    const PartitionInstance &instance;
+    const Cost &cost;
+    const size_t n_parts;
+    std::vector<size_t> part;
+    std::vector<size_t> sizes;
+    // Total weight of requests that use each partition
+    std::vector<double> reqs_weight;
+    // overlap[u * n_parts + k] is the number of items request u has in
+    // partition k
+    std::vector<size_t> overlap;
+    // lost[x] is the weight of requests for which x is the only item in its
+    // partition
+    std::vector<double> lost;
+    // gained[x * n_parts + b] is the weight of requests containing x that
+    // have no items in partition b
+    std::vector<double> gained;
+    // See PartitionInstance::css_run_weight
+    const double css_weight;
+    // See PartitionInstance::change_mismatches
+    std::vector<size_t> mismatches;
+
+    ItemMoveState(const PartitionInstance &instance, const PartitionSoln &soln,
+                  const Cost &cost)
+        : instance{instance}, cost{cost}, n_parts{soln.n_partitions},
+          css_weight{instance.css_run_weight()} {
+        reset(soln);
+    }
+
+    /// Rebuilds all tables for the given solution.
+    void reset(const PartitionSoln &soln) {
+        part = soln.item_to_partition;
+        mismatches = instance.change_mismatches(part, n_parts);
+        sizes.assign(n_parts, 0);
+        reqs_weight.assign(n_parts, 0.0);
+        overlap.assign(instance.n_requests() * n_parts, 0);
+        lost.assign(instance.n_items, 0.0);
+        gained.assign(instance.n_items * n_parts, 0.0);
+        for (size_t x = 0; x < instance.n_items; x++) {
+            sizes[part[x]] += instance.item_sizes[x];
+        }
+        for (size_t u = 0; u < instance.n_requests(); u++) {
+            for (const size_t x : instance.request_items.row(u)) {
+                overlap[u * n_parts + part[x]]++;
+            }
+            for (size_t k = 0; k < n_parts; k++) {
+                if (overlap[u * n_parts + k] > 0) {
+                    reqs_weight[k] += instance.weights[u];
+                }
+            }
+        }
+        for (size_t x = 0; x < instance.n_items; x++) {
+            for (const size_t u : instance.item_requests.row(x)) {
+                const double w = instance.weights[u];
+                if (overlap[u * n_parts + part[x]] == 1) {
+                    lost[x] += w;
+                }
+                for (size_t k = 0; k < n_parts; k++) {
+                    if (overlap[u * n_parts + k] == 0) {
+                        gained[x * n_parts + k] += w;
+                    }
+                }
+            }
+        }
+    }
+
+    /// Returns the change in cost if item x is moved to partition b.
+    double move_delta(size_t x, size_t b) const {
+        const size_t a = part[x];
+        const size_t size = instance.item_sizes[x];
+        // Requests using a pay for its smaller size, and those that only used
+        // a for x stop paying for it
+        const double cost_after_ban =
+            (reqs_weight[a] *
+             cost_difference(cost, sizes[a], sizes[a] - size)) -
+            (lost[x] * cost(sizes[a] - size));
+        // Requests using b pay for its larger size, and those that start using
+        // b because of x pay for all of it
+        const double cost_after_add =
+            (reqs_weight[b] *
+             cost_difference(cost, sizes[b], sizes[b] + size)) +
+            (gained[x * n_parts + b] * cost(sizes[b] + size));
+        const double css_delta =
+            css_weight > 0.0
+                ? css_weight *
+                      static_cast<double>(instance.css_runs_delta(part, x, b))
+                : 0.0;
+        const double change_delta =
+            instance.has_change_cost()
+                ? instance.change_cost_delta(
+                      mismatches, a, b, 1,
+                      instance.change_cost.previous[x] == a ? 1 : 0,
+                      instance.change_cost.previous[x] == b ? 1 : 0)
+                : 0.0;
+        return cost_after_ban + cost_after_add + css_delta + change_delta;
+    }
+
+    /// Returns whether moving item x to partition b keeps the partition size
+    /// bounds, see \ref PartitionInstance::allows_move.
+    bool allows_move(size_t x, size_t b) const {
+        return instance.allows_move(sizes[part[x]], sizes[b],
+                                    instance.item_sizes[x]);
+    }
+
+    /// Returns the best (delta, target) pair for moving item x, or an
+    /// infinite delta and the current partition if no move is allowed.
+    std::pair<double, size_t> best_move(size_t x) const {
+        std::pair best{std::numeric_limits<double>::infinity(), part[x]};
+        for (size_t b = 0; b < n_parts; b++) {
+            if (b != part[x] && allows_move(x, b)) {
+                best = std::min(best, std::pair{move_delta(x, b), b});
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Moves item x to partition b, calling on_change(y) for every item y whose
+     * move deltas changed other than through partition sizes, weights and
+     * changes.
+     */
+    template <typename F> void apply_move(size_t x, size_t b, F &&on_change) {
+        const size_t a = part[x];
+        const auto items_in = [&](size_t u, size_t k) {
+            return instance.request_items.row(u) |
+                   ranges::views::filter([&, k](size_t y) {
+                       return part[y] == k;
+                   });
+        };
+        for (const size_t u : instance.item_requests.row(x)) {
+            const double w = instance.weights[u];
+            size_t &in_a = overlap[u * n_parts + a];
+            size_t &in_b = overlap[u * n_parts + b];
+            // x is about to leave a
+            if (in_a == 1) {
+                lost[x] -= w;
+            }
+            in_a--;
+            if (in_a == 0) {
+                // Nobody in u uses a anymore
+                reqs_weight[a] -= w;
+                for (const size_t y : instance.request_items.row(u)) {
+                    gained[y * n_parts + a] += w;
+                    on_change(y);
+                }
+            } else if (in_a == 1) {
+                // The remaining item of u in a is now alone
+                for (const size_t y : items_in(u, a)) {
+                    if (y != x) {
+                        lost[y] += w;
+                        on_change(y);
+                    }
+                }
+            }
+            // x is about to join b
+            if (in_b == 0) {
+                reqs_weight[b] += w;
+                for (const size_t y : instance.request_items.row(u)) {
+                    gained[y * n_parts + b] -= w;
+                    on_change(y);
+                }
+                lost[x] += w;
+            } else if (in_b == 1) {
+                for (const size_t y : items_in(u, b)) {
+                    lost[y] -= w;
+                    on_change(y);
+                }
+            }
+            in_b++;
+        }
+        part[x] = b;
+        if (instance.has_change_cost()) {
+            const size_t k = instance.change_cost.previous[x];
+            mismatches[a] = k == a ? mismatches[a] + 1 : mismatches[a] - 1;
+            mismatches[b] = k == b ? mismatches[b] - 1 : mismatches[b] + 1;
+        }
+        sizes[a] -= instance.item_sizes[x];
+        sizes[b] += instance.item_sizes[x];
+        if (css_weight > 0.0) {
+            // Neighbors of x gain or lose runs with it
+            for (const size_t y : instance.css_cost.neighbors.row(x)) {
+                on_change(y);
+            }
+        }
+        on_change(x);
+    }
+};
+
+} // namespace optift
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef OPTIFT_ITEM_SET_H
+#define OPTIFT_ITEM_SET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <vector>
+
+#include "dynamic_bitset.h"
+
+namespace optift {
+
+/**
+ * A set of items out of n_items that adapts its representation to its
+ * density, in the style of roaring bitmaps: sparse sets are sorted arrays of
+ * item indices, dense sets are \ref DynamicBitSet bitmaps. Binary operations
+ * pick an algorithm for each pair of representations, so that their cost
+ * scales with the smaller set rather than with n_items whenever one side is
+ * sparse:
+ *
+ * - array and array: linear merge, or galloping search in the larger array if
+ *   the sizes are very different
+ * - array and bitmap: one bit probe per array element
+ * - bitmap and bitmap: the SIMD word kernels of \ref bitset_kernels
+ *
+ * Sets switch representation when their size crosses a threshold, with some
+ * hysteresis so that a set hovering around it does not convert back and forth.
+ * The storage of the unused representation is kept, so that scratch sets do
+ * not allocate once warm.
+ */
+class ItemSet {
+  public:
+    using Index = uint32_t;
+
+    /// Creates an empty set.
+    explicit ItemSet(size_t n) : n_items{n} {}
+
+    /// Creates a set from a range of items, in any order and possibly with
+    /// duplicates.
+    template <std::ranges::input_range Container>
+    ItemSet(size_t n, const Container &c) : n_items{n} {
+        for (const size_t i : c) {
+            array.push_back(static_cast<Index>(i));
+        }
+        std::ranges::sort(array);
+        array.erase(std::ranges::unique(array).begin(), array.end());
+        cardinality = array.size();
+        normalize();
+    }
+
+    size_t universe() const { return n_items; }
+    size_t size() const { return cardinality; }
+    bool empty() const { return cardinality == 0; }
+    bool is_dense() const { return dense; }
+
+    bool test(size_t i) const;
+
+    /**
+     * Writes the intersection with the other set into inter, which must have
+     * the same universe. inter is an array unless both sets are bitmaps.
+     *
+     * \return The size of the intersection
+     */
+    size_t intersect_into(const ItemSet &other, ItemSet &inter) const;
+
+    bool is_disjoint(const ItemSet &other) const;
+
+    /// Removes all items of the other set from this one.
+    void subtract(const ItemSet &other);
+
+    /// Adds all items of the other set to this one.
+    void unite(const ItemSet &other);
+
+    /// Calls f with the index of every item in the set, in increasing order.
+    template <typename F> void for_each(F &&f) const {
+        if (dense) {
+            bitmap.for_each(f);
+        } else {
+            for (const Index i : array) {
+                f(static_cast<size_t>(i));
+            }
+        }
+    }
+
+  private:
+    size_t n_items;
+    size_t cardinality = 0;
+    bool dense = false;
+    // Sorted items, valid if !dense
+    std::vector<Index> array;
+    // Valid if dense. Has no words until the set first becomes dense.
+    DynamicBitSet bitmap{0};
+
+    void assert_same_universe(const ItemSet &other) const;
+    /// Makes bitmap valid for the current items and switches to it.
+    void to_bitmap();
+    /// Makes array valid for the current items and switches to it.
+    void to_array();
+    /// Switches representation if the size crossed a threshold.
+    void normalize();
+};
+
+} // namespace optift
+
+#endif
@@ -1,8 +1,14 @@
 #ifndef OPTIFT_PARTITIONER_H
 #define OPTIFT_PARTITIONER_H
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <optional>
+#include <span>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -11,8 +17,164 @@ namespace optift {
 
 using CostModel = std::function<double(size_t)>;
 
+/**
+ * A sparse boolean matrix in compressed sparse row (CSR) form. The column
+ * indices of row i are indices[offsets[i]..offsets[i + 1]), sorted and without
+ * duplicates.
+ */
+struct CsrMatrix {
+    std::vector<size_t> offsets{0};
+    std::vector<size_t> indices;
+
+    size_t n_rows() const { return offsets.size() - 1; }
+
+    std::span<const size_t> row(size_t i) const {
+        return std::span{indices}.subspan(offsets[i],
+                                          offsets[i + 1] - offsets[i]);
+    }
+
+    /// Appends a row. The columns are sorted and deduplicated.
+    void push_row(std::vector<size_t> columns);
+
+    /// Returns the transpose, which has n_cols rows.
+    CsrMatrix transpose(size_t n_cols) const;
+
+    /// Overwrites result with the transpose, reusing its storage.
+    void transpose_into(size_t n_cols, CsrMatrix &result) const;
+};
+
+/**
+ * Estimated size of the CSS that lists the codepoints of every partition in
+ * unicode-range, one token per run of consecutive codepoints. Every request
+ * loads all of the CSS, so every run costs every request bytes_per_run.
+ */
+struct CssCost {
+    // Bytes of CSS per run, over all the @font-face rules that repeat it. 0
+    // disables the CSS cost.
+    double bytes_per_run = 0.0;
+    // neighbors.row(x) has an entry y for every pair of consecutive
+    // codepoints of which one is in item x and the other in item y != x, so
+    // it may have repeated entries
+    CsrMatrix neighbors;
+    // Number of runs if every item were a partition of its own
+    size_t base_runs = 0;
+
+    /**
+     * Creates the CSS cost of items from pairs of items holding consecutive
+     * codepoints.
+     *
+     * \param n_items The number of items
+     * \param pairs One (x, y) pair per pair of consecutive codepoints, in any
+     *   order. Pairs with x == y join two runs within an item, and are
+     *   subtracted from base_runs.
+     * \param base_runs Number of runs if every item were a partition of its
+     *   own, not counting pairs
+     * \param bytes_per_run See bytes_per_run
+     */
+    static CssCost from_pairs(size_t n_items,
+                              std::span<const std::pair<size_t, size_t>> pairs,
+                              size_t base_runs, double bytes_per_run);
+};
+
 struct PartitionSoln {
-    std::vector<std::unordered_set<size_t>> partitions;
+    // The number of partitions
+    size_t n_partitions;
+    // item_to_partition[i] is the partition item i is assigned to
+    std::vector<size_t> item_to_partition;
+
+    /// Converts a vector of item sets, one per partition, to a solution.
+    static PartitionSoln
+    from_partitions(const std::vector<std::unordered_set<size_t>> &partitions,
+                    size_t n_items);
+
+    /// Returns the sorted items of each partition.
+    std::vector<std::vector<size_t>> partitions() const;
+};
+
+struct PartitionInstance;
+
+/**
+ * Cost of changing the partitions of a previous solution, e.g. because every
+ * returning visitor downloads a changed partition again. Partition k of a
+ * solution is unchanged if it holds exactly the items that were in partition k
+ * of the previous solution, so that its file can be served as before.
+ */
+struct ChangeCost {
+    // Marks items that were in no partition of the previous solution
+    static constexpr size_t NEW = std::numeric_limits<size_t>::max();
+
+    // Partition of each item in the previous solution, or NEW
+    std::vector<size_t> previous;
+    // Size of each partition of the previous solution, in bytes
+    std::vector<double> partition_bytes;
+    // Cost of changing each partition of the previous solution. Empty if
+    // there is no previous solution.
+    std::vector<double> partition_costs;
+
+    /**
+     * Creates the change cost of a previous solution, in which changing a
+     * partition costs penalty times its size times the weight of the requests
+     * that used it, i.e. what requests download again if they have the
+     * previous partitions cached.
+     *
+     * \param instance The instance, whose requests weigh the partitions
+     * \param previous See previous
+     * \param partition_bytes See partition_bytes
+     * \param penalty Multiplies the cost of every partition
+     */
+    static ChangeCost from_previous(const PartitionInstance &instance,
+                                    std::vector<size_t> previous,
+                                    std::vector<double> partition_bytes,
+                                    double penalty);
+
+    /// Returns the previous solution as a solution with n_partitions
+    /// partitions, with new items in the last partition, which must not be a
+    /// previous one.
+    PartitionSoln warm_start(size_t n_partitions) const;
+};
+
+/// Summary of a per-request quantity, weighted by request weight.
+struct WeightedSummary {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+/// Distribution of the cost of a solution over requests.
+struct EvalReport {
+    // Total weighted cost, as returned by PartitionInstance::eval
+    double total = 0.0;
+    // Cost of each request, i.e. bytes per page
+    WeightedSummary cost;
+    // Number of partitions used by each request
+    WeightedSummary partitions;
+};
+
+/**
+ * Function of the per-request costs minimized by
+ * \ref partition_solve_objective. All kinds are scaled like
+ * PartitionInstance::eval, i.e. as sums over requests rather than means.
+ */
+struct Objective {
+    enum class Kind {
+        // Weighted sum of the request costs, as PartitionInstance::eval
+        Mean,
+        // Weighted mean cost of the most expensive tail_fraction of the
+        // requests by weight (the conditional value at risk), times the total
+        // weight
+        Tail,
+        // Weighted sum of the request costs, plus penalty times the part of
+        // each request cost above cap
+        Capped,
+    };
+
+    Kind kind = Kind::Mean;
+    // Weight fraction of the tail, e.g. 0.05 for the 95th percentile
+    double tail_fraction = 0.05;
+    double cap = 0.0;
+    double penalty = 1.0;
 };
 
 struct PartitionInstance {
@@ -20,19 +182,471 @@ struct PartitionInstance {
     size_t n_partitions;
     // The number of items in the instance
     size_t n_items;
-    // Request as (weight, set of item) pairs
-    std::vector<std::pair<double, std::unordered_set<size_t>>> requests;
+    // Size of each item, which the cost model maps to bytes: the number of
+    // glyphs it stands for, or its outline size in units of the cost model.
+    // All ones for single glyphs, unless items were merged by
+    // coarsen_instance.
+    std::vector<size_t> item_sizes;
+    // Weight of each request
+    std::vector<double> weights;
+    // Request to items, one row per request
+    CsrMatrix request_items;
+    // Item to requests, the transpose of request_items
+    CsrMatrix item_requests;
 
     CostModel cost_model;
+    // Minimized by partition_solve_objective. The solvers themselves always
+    // minimize eval, i.e. the weighted sum of the request costs.
+    Objective objective;
+    // Bounds on the total item size of every non-empty partition. The
+    // heuristic, FM, annealing and minibatch solvers make no move that takes
+    // a solution further outside them, and partition_repair_sizes brings a
+    // solution within them.
+    size_t min_partition_size = 0;
+    size_t max_partition_size = std::numeric_limits<size_t>::max();
+    // Added to the cost of every request by request_costs and eval, and to
+    // move deltas by the heuristic, FM, annealing and minibatch solvers
+    CssCost css_cost;
+    // Added to eval, and to move deltas by the heuristic, FM, annealing and
+    // minibatch solvers, which then also keep partition numbers as they are
+    ChangeCost change_cost;
+
+    size_t n_requests() const { return weights.size(); }
+
+    bool has_css_cost() const { return css_cost.bytes_per_run > 0.0; }
+
+    /// Returns the number of unicode-range runs of a solution, see CssCost.
+    size_t css_runs(std::span<const size_t> item_to_partition) const;
+
+    /// Returns the change in the number of unicode-range runs if item x is
+    /// moved to partition b.
+    std::ptrdiff_t css_runs_delta(std::span<const size_t> item_to_partition,
+                                  size_t x, size_t b) const {
+        const size_t a = item_to_partition[x];
+        std::ptrdiff_t delta = 0;
+        for (const size_t y : css_cost.neighbors.row(x)) {
+            // x leaves a run in a and joins one in b
+            delta += static_cast<std::ptrdiff_t>(item_to_partition[y] == a) -
+                     static_cast<std::ptrdiff_t>(item_to_partition[y] == b);
+        }
+        return delta;
+    }
+
+    /// Returns the cost of one unicode-range run over all requests.
+    double css_run_weight() const;
+
+    bool has_change_cost() const {
+        return !change_cost.partition_costs.empty();
+    }
+
+    /**
+     * Returns, for every partition of a solution with n_partitions partitions,
+     * the number of items that it gained or lost since the previous solution,
+     * see ChangeCost. Partitions with none are unchanged.
+     */
+    std::vector<size_t>
+    change_mismatches(std::span<const size_t> item_to_partition,
+                      size_t n_partitions) const;
+
+    /// Returns the change cost of a solution.
+    double eval_changes(const PartitionSoln &soln) const;
+
+    /// Returns the total size in bytes of the previous partitions that a
+    /// solution changes.
+    double changed_bytes(const PartitionSoln &soln) const;
+
+    /**
+     * Returns the change in the change cost if n_moved items are moved from
+     * partition a to partition b, of which from_a were previously in a and
+     * from_b previously in b.
+     *
+     * \param mismatches See change_mismatches
+     */
+    double change_cost_delta(std::span<const size_t> mismatches, size_t a,
+                             size_t b, size_t n_moved, size_t from_a,
+                             size_t from_b) const {
+        const auto partition_delta = [&](size_t k, std::ptrdiff_t delta) {
+            if (k >= change_cost.partition_costs.size()) {
+                return 0.0;
+            }
+            const bool changed = mismatches[k] > 0;
+            const bool changes =
+                static_cast<std::ptrdiff_t>(mismatches[k]) + delta > 0;
+            return change_cost.partition_costs[k] *
+                   (static_cast<double>(changes) -
+                    static_cast<double>(changed));
+        };
+        const auto n = static_cast<std::ptrdiff_t>(n_moved);
+        // Items that were in a are missing from it once moved, the others
+        // no longer extra, and conversely for b
+        return partition_delta(a, 2 * static_cast<std::ptrdiff_t>(from_a) - n) +
+               partition_delta(b, n - 2 * static_cast<std::ptrdiff_t>(from_b));
+    }
+
+    bool has_size_bounds() const {
+        return min_partition_size > 0 ||
+               max_partition_size < std::numeric_limits<size_t>::max();
+    }
+
+    /// Returns how far a partition of the given size is outside the size
+    /// bounds. Empty partitions are always within them.
+    size_t size_violation(size_t size) const {
+        if (size > max_partition_size) {
+            return size - max_partition_size;
+        }
+        return size > 0 && size < min_partition_size
+                   ? min_partition_size - size
+                   : 0;
+    }
+
+    /**
+     * Returns whether moving items of total size moved from a partition of
+     * size from_size to one of size to_size does not take the two further
+     * outside the size bounds. Moves to an empty partition only need to stay
+     * within the maximum size, so that new partitions can grow to the minimum
+     * size one move at a time.
+     */
+    bool allows_move(size_t from_size, size_t to_size, size_t moved) const {
+        const size_t to_violation =
+            to_size == 0 && to_size + moved <= max_partition_size
+                ? 0
+                : size_violation(to_size + moved);
+        return size_violation(from_size - moved) + to_violation <=
+               size_violation(from_size) + size_violation(to_size);
+    }
 
+    /**
+     * Creates an instance from per-request weights and items. The item to
+     * request index is derived from request_items.
+     */
+    static PartitionInstance from_csr(size_t n_partitions, size_t n_items,
+                                      std::vector<double> weights,
+                                      CsrMatrix request_items,
+                                      CostModel cost_model);
+
+    /// Creates an instance from requests as (weight, set of item) pairs.
+    static PartitionInstance from_requests(
+        size_t n_partitions, size_t n_items,
+        const std::vector<std::pair<double, std::unordered_set<size_t>>>
+            &requests,
+        CostModel cost_model);
+
+    /// Returns the weighted sum of the request costs, plus the change cost.
     double eval(const PartitionSoln &soln) const;
+
+    /// Returns the cost of each request, i.e. the total cost of the
+    /// partitions it uses plus the CSS cost.
+    std::vector<double> request_costs(const PartitionSoln &soln) const;
+
+    /// Evaluates objective. This is eval for Objective::Kind::Mean.
+    double eval_objective(const PartitionSoln &soln) const;
+
+    /**
+     * Returns request weights with which eval has the same slope as
+     * eval_objective at soln, with respect to the cost of each request. See
+     * \ref partition_solve_objective.
+     */
+    std::vector<double> objective_weights(const PartitionSoln &soln) const;
+
+    /**
+     * Returns a lower bound on the cost of any solution with n_partitions
+     * partitions, the larger of two relaxations: each request costs at least
+     * as much as its own items would if they were split over partitions of the
+     * cheapest size per glyph, and each partition costs at least as much as if
+     * only the requests of its most requested item used it. Neither accounts
+     * for which items are requested together, so the bound is loose unless
+     * requests are well separated.
+     */
+    double lower_bound() const;
+
+    /**
+     * Evaluates a solution with given partition costs, e.g. the real sizes of
+     * the subsetted fonts, and summarizes the cost per request. The CSS cost
+     * is not included.
+     *
+     * \param soln The solution. Its number of partitions is not checked
+     *   against n_partitions.
+     * \param partition_costs The cost of each partition of soln
+     * \return The total cost and its distribution over requests
+     */
+    EvalReport eval_report(const PartitionSoln &soln,
+                           std::span<const double> partition_costs) const;
+};
+
+/**
+ * Limits and hooks shared by the solvers, so that long solves can be bounded,
+ * interrupted and checkpointed. A solver that hits a limit stops early and
+ * returns the best solution it has found so far.
+ */
+struct SolveControl {
+    using Clock = std::chrono::steady_clock;
+
+    // Solvers stop once this time point has passed
+    Clock::time_point deadline = Clock::time_point::max();
+    // Maximum number of iterations of partition_solve_heuristic, 0 for no limit
+    size_t max_iterations = 0;
+    // Solvers stop soon after this is set, e.g. from a signal handler
+    const std::atomic<bool> *interrupt = nullptr;
+    // Called with the current solution, at most once per checkpoint_interval
+    std::function<void(const PartitionSoln &)> checkpoint;
+    std::chrono::duration<double> checkpoint_interval{60.0};
+    // Time of the last checkpoint, shared by all solvers using this control
+    mutable Clock::time_point last_checkpoint = Clock::now();
+    // Solvers stop once their solution costs at most this, e.g. once it is
+    // within a tolerance of PartitionInstance::lower_bound
+    double target_cost = 0.0;
+
+    /// Returns whether the solver should stop and return what it has.
+    bool should_stop() const {
+        return (interrupt != nullptr && interrupt->load()) ||
+               Clock::now() >= deadline;
+    }
+
+    /// Returns whether a solution of the given cost is good enough to stop.
+    bool reached_target(double cost) const { return cost <= target_cost; }
+
+    /// Calls checkpoint with make_soln() if checkpoint_interval has passed
+    /// since the last checkpoint.
+    template <typename F> void maybe_checkpoint(F &&make_soln) const {
+        if (checkpoint && Clock::now() - last_checkpoint >=
+                              std::chrono::duration_cast<Clock::duration>(
+                                  checkpoint_interval)) {
+            checkpoint(make_soln());
+            last_checkpoint = Clock::now();
+        }
+    }
+};
+
+struct AnnealingOptions {
+    // Wall-clock time budget of the search
+    std::chrono::duration<double> time_budget;
+    // Number of concurrent annealing chains, 0 for one per hardware thread
+    size_t n_chains = 0;
+    // RNG seed, chain i uses seed + i
+    uint64_t seed = 0;
+};
+
+struct MinibatchOptions {
+    // Number of requests drawn for each batch
+    size_t batch_size = 4096;
+    // Number of batches between two validations on all requests
+    size_t validation_interval = 4;
+    // The solver stops after this many validations in a row without
+    // improvement
+    size_t patience = 4;
+    // RNG seed
+    uint64_t seed = 0;
+};
+
+/// A solution found by \ref partition_sweep for a given number of partitions.
+struct PartitionSweepPoint {
+    size_t n_partitions;
+    double cost;
+    PartitionSoln soln;
 };
 
+/**
+ * An instance in which groups of items are merged into single items, and
+ * requests that become identical are merged by summing their weights. Merged
+ * items always end up in the same partition, and the cost of any such solution
+ * is the same in the original and the coarse instance.
+ */
+struct CoarsenedInstance {
+    PartitionInstance instance;
+    // item_map[i] is the coarse item of original item i
+    std::vector<size_t> item_map;
+
+    /// Maps a solution of the coarse instance back to the original items.
+    PartitionSoln project(const PartitionSoln &soln) const;
+
+    /// Maps a solution of the original instance to the coarse instance. Each
+    /// coarse item goes to the partition of its first original item.
+    PartitionSoln restrict(const PartitionSoln &soln) const;
+};
+
+/**
+ * Merges items of an instance into coarse items.
+ *
+ * \param item_map item_map[i] is the coarse item of item i
+ * \param n_items The number of coarse items
+ */
+CoarsenedInstance contract_instance(const PartitionInstance &instance,
+                                    std::vector<size_t> item_map,
+                                    size_t n_items);
+
+/// Merges items with identical sets of requests.
+CoarsenedInstance coarsen_instance(const PartitionInstance &instance);
+
 PartitionSoln partition_solve_baseline(const PartitionInstance &instance);
 
+/**
+ * Constructive solver, used as the starting point of the other solvers. Items
+ * are ranked by weighted document frequency, with items requested together
+ * kept next to each other within bands of similar frequency, and the ranking
+ * is cut into partitions from a core of common items down to rare ones. Cuts
+ * are chosen by dynamic programming to minimize the cost over a grid of
+ * candidate positions.
+ */
+PartitionSoln partition_solve_greedy(const PartitionInstance &instance);
+
 PartitionSoln partition_solve_heuristic(const PartitionInstance &instance,
-                                        PartitionSoln initial_soln);
+                                        PartitionSoln initial_soln,
+                                        const SolveControl &control = {});
+
+/// Returns a starting solution of an instance, such as
+/// \ref partition_solve_greedy or \ref partition_solve_baseline.
+using InitialSolver = std::function<PartitionSoln(const PartitionInstance &)>;
+
+/**
+ * Multilevel solver for large instances. Items that are often requested
+ * together are repeatedly clustered into coarse items until few items are
+ * left. The coarsest instance is solved with \ref partition_refine_fm from the
+ * solution of initial_solver, and the solution is projected back and refined
+ * with \ref partition_refine_fm level by level.
+ */
+PartitionSoln
+partition_solve_multilevel(const PartitionInstance &instance,
+                           const InitialSolver &initial_solver =
+                               partition_solve_greedy,
+                           const SolveControl &control = {});
+
+/**
+ * Stochastic solver for instances with very many requests. Each round draws a
+ * batch of requests with probability proportional to their weight, so that the
+ * cost of the batch with equal weights is an unbiased estimate of the total
+ * cost, and moves each item of the batch to its best partition for the batch.
+ * The solution is periodically validated on all requests, and rounds that made
+ * it worse are rolled back. Besides the periodic validations, memory and time
+ * per round scale with the batch size and with the number of items times the
+ * number of partitions, for the move state, but not with the number of
+ * requests. The cost model is tabulated once, and the batch and the move state
+ * are refilled every round.
+ */
+PartitionSoln partition_solve_minibatch(const PartitionInstance &instance,
+                                        PartitionSoln initial_soln,
+                                        const MinibatchOptions &options,
+                                        const SolveControl &control = {});
+
+/**
+ * Brings a solution within the partition size bounds of the instance, as
+ * cheaply as it can. Items of oversized partitions are moved one at a time,
+ * lowest cost increase first, to partitions with room for them. Then the
+ * smallest undersized partition is merged into the partition that makes the
+ * merge cheapest while staying within the maximum size, until no undersized
+ * partition is left or none can be merged. Bounds that cannot be met, e.g.
+ * because an item alone is too large, are logged and left violated.
+ */
+PartitionSoln partition_repair_sizes(const PartitionInstance &instance,
+                                     PartitionSoln soln);
+
+/**
+ * Minimizes instance.objective with a solver for the weighted sum of request
+ * costs. Each round linearizes the objective at the current solution, giving
+ * every request the weight from PartitionInstance::objective_weights, and
+ * runs solve on the reweighted instance. Move deltas of the solvers are then
+ * exact for requests that do not cross a kink of the objective, such as the
+ * cap or the tail quantile, and first-order for those that do. The weights
+ * are a step between the original ones and the linearized ones, starting at
+ * the linearized ones. A round is kept only if it improves the objective;
+ * otherwise the step is halved, as a line search. Rounds stop once the step
+ * falls below 1/16, after max_rounds, or when control says to stop.
+ *
+ * \param solve Called with the reweighted instance and the current solution
+ */
+PartitionSoln partition_solve_objective(
+    const PartitionInstance &instance, PartitionSoln soln,
+    const std::function<PartitionSoln(const PartitionInstance &,
+                                      PartitionSoln)> &solve,
+    const SolveControl &control = {}, size_t max_rounds = 16);
+
+/**
+ * Brings the bytes of previous partitions that a solution changes, see
+ * \ref ChangeCost, down to a limit. Each round doubles the change cost of the
+ * instance and runs solve from the previous solution, until the solution is
+ * within the limit. If it still is not after max_rounds, the previous solution
+ * is returned, which changes no partition.
+ *
+ * \param soln The solution, returned as is if within the limit
+ * \param solve Called with the instance with a higher change cost and the
+ *   previous solution
+ * \param max_changed_bytes The limit on PartitionInstance::changed_bytes
+ */
+PartitionSoln partition_limit_changes(
+    const PartitionInstance &instance, PartitionSoln soln,
+    const std::function<PartitionSoln(const PartitionInstance &,
+                                      PartitionSoln)> &solve,
+    double max_changed_bytes, const SolveControl &control = {},
+    size_t max_rounds = 16);
+
+/**
+ * Refines a solution by moving single items between partitions, in
+ * Fiduccia-Mattheyses style passes: items are moved greedily by gain (even if
+ * the gain is negative) and locked, and each pass is rolled back to its best
+ * prefix. Passes are repeated until one fails to improve the cost.
+ */
+PartitionSoln partition_refine_fm(const PartitionInstance &instance,
+                                  PartitionSoln soln,
+                                  const SolveControl &control = {});
+
+/**
+ * Splits one partition of a solution into two, picking the partition whose
+ * split gives the lowest cost. The rarer half of the items (by total request
+ * weight) goes to the new partition.
+ *
+ * \param instance The instance, with one more partition than soln
+ * \param soln The solution to split
+ * \return A solution with instance.n_partitions partitions
+ */
+PartitionSoln partition_split(const PartitionInstance &instance,
+                              const PartitionSoln &soln);
+
+/**
+ * Solves the instance for every number of partitions from
+ * instance.n_partitions to max_partitions. The first solution starts from
+ * \ref partition_solve_greedy, and each following one is warm-started by
+ * splitting a partition of the previous one. Each solution is brought within
+ * the partition size bounds by \ref partition_repair_sizes. If the solve is
+ * stopped early, only the points solved so far are returned.
+ */
+std::vector<PartitionSweepPoint>
+partition_sweep(const PartitionInstance &instance, size_t max_partitions,
+                const SolveControl &control = {});
+
+/**
+ * Exact branch and bound solver, for instances with few items: the search
+ * tree has up to n_partitions^n_items leaves. The search starts from the
+ * given solution and only keeps strictly better ones.
+ *
+ * \return The best solution found, and whether it is proven optimal. It is
+ *   not if the search was stopped early by control or by its node limit.
+ */
+std::pair<PartitionSoln, bool>
+partition_solve_exact(const PartitionInstance &instance,
+                      PartitionSoln incumbent,
+                      const SolveControl &control = {});
+
+/**
+ * Picks a number of partitions from a sweep. With a tolerance, this is the
+ * smallest number of partitions whose cost is within that relative tolerance
+ * of the best cost. Otherwise it is the knee of the cost curve, i.e. the point
+ * farthest below the line joining its two ends.
+ *
+ * \return The index of the chosen point in sweep
+ */
+size_t partition_sweep_select(std::span<const PartitionSweepPoint> sweep,
+                              std::optional<double> tolerance);
+
+/**
+ * Improves a solution with concurrent simulated annealing chains on single
+ * item moves, under a wall-clock time budget. The chains periodically exchange
+ * the best solution found so far, and the result is polished with
+ * \ref partition_refine_fm.
+ */
+PartitionSoln partition_solve_annealing(const PartitionInstance &instance,
+                                        PartitionSoln initial_soln,
+                                        const AnnealingOptions &options,
+                                        const SolveControl &control = {});
 
 } // namespace optift
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,248 @@
+#include "access_log.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+using namespace optift;
+
+// Sessions idle for longer than the timeout are closed every this many lines,
+// which bounds the memory taken by open sessions
+constexpr size_t ACCESS_LOG_EXPIRE_LINES = 1 << 16;
+
+namespace {
+
+using SysSeconds = std::chrono::sys_seconds;
+
+/// Fields of an access log line that sessions are reconstructed from.
+struct LogLine {
+    std::string_view addr;
+    SysSeconds time;
+    std::string_view method;
+    std::string_view path;
+    int status;
+    std::string_view user_agent;
+};
+
+/// Parses a non-negative integer of exactly s.size() digits.
+std::optional<int> parse_int(std::string_view s) {
+    int value = 0;
+    const auto [end, ec] =
+        std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc{} || end != s.data() + s.size() || value < 0) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+/// Parses a time such as "10/Oct/2000:13:55:36 -0700".
+std::optional<SysSeconds> parse_log_time(std::string_view s) {
+    constexpr std::array<std::string_view, 12> MONTHS{
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+    };
+    // dd/Mmm/yyyy:hh:mm:ss +zzzz
+    constexpr size_t LENGTH = 26;
+    if (s.size() != LENGTH || s[2] != '/' || s[6] != '/' || s[11] != ':' ||
+        s[14] != ':' || s[17] != ':' || s[20] != ' ' ||
+        (s[21] != '+' && s[21] != '-')) {
+        return std::nullopt;
+    }
+    const auto month = std::ranges::find(MONTHS, s.substr(3, 3));
+    const auto day = parse_int(s.substr(0, 2));
+    const auto year = parse_int(s.substr(7, 4));
+    const auto hours = parse_int(s.substr(12, 2));
+    const auto minutes = parse_int(s.substr(15, 2));
+    const auto seconds = parse_int(s.substr(18, 2));
+    const auto offset_hours = parse_int(s.substr(22, 2));
+    const auto offset_minutes = parse_int(s.substr(24, 2));
+    if (month == MONTHS.end() || !day || !year || !hours || !minutes ||
+        !seconds || !offset_hours || !offset_minutes) {
+        return std::nullopt;
+    }
+    const std::chrono::year_month_day date{
+        std::chrono::year{*year},
+        std::chrono::month{
+            static_cast<unsigned>(month - MONTHS.begin() + 1)},
+        std::chrono::day{static_cast<unsigned>(*day)}};
+    if (!date.ok()) {
+        return std::nullopt;
+    }
+    const std::chrono::minutes offset{*offset_hours * 60 + *offset_minutes};
+    return SysSeconds{std::chrono::sys_days{date}} +
+           std::chrono::hours{*hours} + std::chrono::minutes{*minutes} +
+           std::chrono::seconds{*seconds} -
+           (s[21] == '-' ? -offset : offset);
+}
+
+/**
+ * Splits off the next field of a log line: a run of characters up to a space,
+ * or text enclosed in the given delimiters, which may contain backslash
+ * escapes. Leading spaces are skipped.
+ */
+std::optional<std::string_view> next_field(std::string_view &line,
+                                           char open = ' ', char close = ' ') {
+    while (!line.empty() && line.front() == ' ') {
+        line.remove_prefix(1);
+    }
+    if (line.empty()) {
+        return std::nullopt;
+    }
+    if (open == ' ') {
+        const size_t end = std::min(line.find(' '), line.size());
+        const std::string_view field = line.substr(0, end);
+        line.remove_prefix(end);
+        return field;
+    }
+    if (line.front() != open) {
+        return std::nullopt;
+    }
+    for (size_t i = 1; i < line.size(); i++) {
+        if (line[i] == '\\') {
+            i++;
+        } else if (line[i] == close) {
+            const std::string_view field = line.substr(1, i - 1);
+            line.remove_prefix(i + 1);
+            return field;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<LogLine> parse_combined_line(std::string_view line) {
+    const auto addr = next_field(line);
+    const auto ident = next_field(line);
+    const auto user = next_field(line);
+    const auto time = next_field(line, '[', ']');
+    const auto request = next_field(line, '"', '"');
+    const auto status = next_field(line);
+    const auto bytes = next_field(line);
+    const auto referer = next_field(line, '"', '"');
+    const auto user_agent = next_field(line, '"', '"');
+    if (!addr || !ident || !user || !time || !request || !status || !bytes ||
+        !referer || !user_agent) {
+        return std::nullopt;
+    }
+    const auto parsed_time = parse_log_time(*time);
+    const auto parsed_status = parse_int(*status);
+    // "GET /path HTTP/1.1"
+    std::string_view request_line = *request;
+    const auto method = next_field(request_line);
+    const auto path = next_field(request_line);
+    if (!parsed_time || !parsed_status || !method || !path) {
+        return std::nullopt;
+    }
+    return LogLine{
+        .addr = *addr,
+        .time = *parsed_time,
+        .method = *method,
+        .path = *path,
+        .status = *parsed_status,
+        .user_agent = *user_agent,
+    };
+}
+
+struct OpenSession {
+    SysSeconds last;
+    std::vector<std::string> posts;
+};
+
+} // namespace
+
+std::vector<Session>
+optift::read_access_log_sessions(std::istream &in,
+                                 const AccessLogOptions &options) {
+    // Visitor (address and user agent) to their current session
+    std::unordered_map<std::string, OpenSession> open;
+    std::map<std::vector<std::string>, double> closed;
+    const auto close = [&](OpenSession &session) {
+        if (session.posts.empty()) {
+            return;
+        }
+        std::ranges::sort(session.posts);
+        session.posts.erase(std::ranges::unique(session.posts).begin(),
+                            session.posts.end());
+        closed[std::move(session.posts)] += 1.0;
+    };
+
+    size_t n_lines = 0;
+    size_t n_malformed = 0;
+    size_t n_views = 0;
+    size_t n_sessions = 0;
+    SysSeconds now{};
+    std::string line;
+    std::string visitor;
+    std::match_results<std::string_view::const_iterator> match;
+    while (std::getline(in, line)) {
+        n_lines++;
+        if (n_lines % ACCESS_LOG_EXPIRE_LINES == 0) {
+            for (auto it = open.begin(); it != open.end();) {
+                if (now - it->second.last > options.session_timeout) {
+                    close(it->second);
+                    it = open.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        const auto parsed = parse_combined_line(line);
+        if (!parsed) {
+            n_malformed++;
+            continue;
+        }
+        const bool success = (parsed->status >= 200 && parsed->status < 300) ||
+                             parsed->status == 304;
+        if (parsed->method != "GET" || !success ||
+            !std::regex_search(parsed->path.begin(), parsed->path.end(),
+                               match, options.post_pattern)) {
+            continue;
+        }
+        n_views++;
+        now = std::max(now, parsed->time);
+
+        visitor.assign(parsed->addr);
+        visitor.push_back('\t');
+        visitor.append(parsed->user_agent);
+        const auto [it, inserted] = open.try_emplace(visitor);
+        OpenSession &session = it->second;
+        if (inserted ||
+            parsed->time - session.last > options.session_timeout) {
+            close(session);
+            session.posts.clear();
+            n_sessions++;
+        }
+        session.last = std::max(session.last, parsed->time);
+        session.posts.emplace_back(match.size() > 1 && match[1].matched
+                                       ? match[1].str()
+                                       : match[0].str());
+    }
+    for (auto &[_, session] : open) {
+        close(session);
+    }
+    if (n_malformed > 0) {
+        spdlog::warn("skipped {} malformed access log lines", n_malformed);
+    }
+    spdlog::info("access log: {} lines, {} page views, {} sessions ({} "
+                 "distinct sets of posts)",
+                 n_lines, n_views, n_sessions, closed.size());
+
+    std::vector<Session> sessions;
+    sessions.reserve(closed.size());
+    for (auto &[posts, count] : closed) {
+        sessions.push_back({.posts = posts, .count = count});
+    }
+    return sessions;
+}
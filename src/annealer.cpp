@@ -0,0 +1,218 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+
+#include <range/v3/algorithm/sort.hpp>
+#include <range/v3/range/conversion.hpp>
+#include <range/v3/view/iota.hpp>
+
+#include "item_move_state.h"
+
+using namespace optift;
+
+// The time budget is split into this many epochs. Chains exchange solutions
+// at the end of each epoch.
+constexpr size_t ANNEAL_EPOCHS = 16;
+// Number of moves between two checks of the clock
+constexpr size_t ANNEAL_CLOCK_INTERVAL = 1024;
+// Number of random moves used to calibrate the initial temperature
+constexpr size_t ANNEAL_CALIBRATION_MOVES = 4096;
+// Ratio between the final and the initial temperature
+constexpr double ANNEAL_COOLING_RATIO = 1e-3;
+// Probability of picking the target partition among the partitions used by
+// requests of the item, rather than uniformly
+constexpr double ANNEAL_NEIGHBOR_TARGET_PROB = 0.9;
+
+using Clock = SolveControl::Clock;
+
+namespace {
+
+template <typename Cost> struct AnnealingChain {
+    std::mt19937_64 rng;
+    ItemMoveState<Cost> state;
+    double cost;
+    std::vector<size_t> best_part;
+    double best_cost;
+
+    AnnealingChain(const PartitionInstance &instance, const PartitionSoln &soln,
+                   const Cost &cost_model, uint64_t seed)
+        : rng{seed}, state{instance, soln, cost_model},
+          cost{instance.eval(soln)}, best_part{soln.item_to_partition},
+          best_cost{cost} {}
+
+    /// Picks a random item and a random target partition for it. Targets are
+    /// mostly drawn from partitions that already serve requests of the item.
+    std::pair<size_t, size_t> random_move() {
+        const PartitionInstance &instance = state.instance;
+        std::uniform_int_distribution<size_t> item_dist{0,
+                                                        instance.n_items - 1};
+        std::uniform_int_distribution<size_t> part_dist{0, state.n_parts - 2};
+        std::bernoulli_distribution neighbor_dist{ANNEAL_NEIGHBOR_TARGET_PROB};
+
+        const size_t x = item_dist(rng);
+        const auto reqs = instance.item_requests.row(x);
+        if (!reqs.empty() && neighbor_dist(rng)) {
+            const size_t u = reqs[std::uniform_int_distribution<size_t>{
+                0, reqs.size() - 1}(rng)];
+            const auto items = instance.request_items.row(u);
+            const size_t y = items[std::uniform_int_distribution<size_t>{
+                0, items.size() - 1}(rng)];
+            if (state.part[y] != state.part[x]) {
+                return {x, state.part[y]};
+            }
+        }
+        // Uniform over partitions other than the current one
+        const size_t b = part_dist(rng);
+        return {x, b >= state.part[x] ? b + 1 : b};
+    }
+
+    /// Runs Metropolis moves at the given temperature until the deadline or
+    /// until the control asks to stop.
+    void run(Clock::time_point deadline, double temperature,
+             const SolveControl &control) {
+        std::uniform_real_distribution<double> unit{0.0, 1.0};
+        for (;;) {
+            for (size_t k = 0; k < ANNEAL_CLOCK_INTERVAL; k++) {
+                const auto [x, b] = random_move();
+                if (!state.allows_move(x, b)) {
+                    continue;
+                }
+                const double delta = state.move_delta(x, b);
+                if (delta < 0.0 ||
+                    unit(rng) < std::exp(-delta / temperature)) {
+                    state.apply_move(x, b, [](size_t) {});
+                    cost += delta;
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_part = state.part;
+                    }
+                }
+            }
+            if (Clock::now() >= deadline || control.should_stop()) {
+                break;
+            }
+        }
+    }
+};
+
+/// Estimates a starting temperature as the mean cost increase of random
+/// uphill moves, so that a typical uphill move is initially accepted with
+/// probability 1/e.
+template <typename Cost>
+double calibrate_temperature(AnnealingChain<Cost> &chain) {
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t k = 0; k < ANNEAL_CALIBRATION_MOVES; k++) {
+        const auto [x, b] = chain.random_move();
+        if (!chain.state.allows_move(x, b)) {
+            continue;
+        }
+        if (const double delta = chain.state.move_delta(x, b); delta > 0.0) {
+            sum += delta;
+            count++;
+        }
+    }
+    return count > 0 ? sum / static_cast<double>(count) : 1.0;
+}
+
+/// Simulated annealing for a cost model of type Cost, see
+/// \ref partition_solve_annealing.
+template <typename Cost>
+PartitionSoln anneal(const PartitionInstance &instance,
+                     const PartitionSoln &initial_soln,
+                     const AnnealingOptions &options,
+                     const SolveControl &control, const Cost &cost) {
+    const size_t n_chains =
+        options.n_chains > 0
+            ? options.n_chains
+            : static_cast<size_t>(tbb::info::default_concurrency());
+
+    std::vector<AnnealingChain<Cost>> chains;
+    chains.reserve(n_chains);
+    for (size_t i = 0; i < n_chains; i++) {
+        chains.emplace_back(instance, initial_soln, cost, options.seed + i);
+    }
+    const double t_start = calibrate_temperature(chains.front());
+    const double t_end = t_start * ANNEAL_COOLING_RATIO;
+
+    PartitionSoln best = initial_soln;
+    double best_cost = instance.eval(best);
+    spdlog::debug("annealing with {} chains, temperature {:.3f} -> {:.3f}",
+                  n_chains, t_start, t_end);
+
+    const auto start = Clock::now();
+    const auto budget =
+        std::chrono::duration_cast<Clock::duration>(options.time_budget);
+    for (size_t epoch = 0; epoch < ANNEAL_EPOCHS; epoch++) {
+        // Geometric cooling, with the temperature fixed within an epoch
+        const double progress =
+            static_cast<double>(epoch) / static_cast<double>(ANNEAL_EPOCHS);
+        const double temperature =
+            t_start * std::pow(t_end / t_start, progress);
+        const auto deadline = start + (budget * static_cast<long>(epoch + 1) /
+                                       static_cast<long>(ANNEAL_EPOCHS));
+        tbb::parallel_for(size_t(0), n_chains, [&](size_t i) {
+            chains[i].run(deadline, temperature, control);
+        });
+
+        // Collect the best solution so far. Ties go to the lowest chain so
+        // that the exchange does not depend on scheduling.
+        for (auto &chain : chains) {
+            // Re-evaluate exactly to get rid of accumulated rounding errors
+            PartitionSoln soln{instance.n_partitions, chain.best_part};
+            chain.best_cost = instance.eval(soln);
+            if (chain.best_cost < best_cost) {
+                best_cost = chain.best_cost;
+                best = std::move(soln);
+            }
+            chain.cost =
+                instance.eval({instance.n_partitions, chain.state.part});
+        }
+        // The worse half of the chains restarts from the best solution
+        std::vector<size_t> order = ranges::views::iota(size_t(0), n_chains) |
+                                    ranges::to<std::vector>();
+        ranges::sort(order, std::less<>{}, [&](size_t i) {
+            return std::pair{chains[i].cost, i};
+        });
+        for (size_t k = (n_chains + 1) / 2; k < n_chains; k++) {
+            AnnealingChain<Cost> &chain = chains[order[k]];
+            chain.state.reset(best);
+            chain.cost = best_cost;
+        }
+        spdlog::debug(
+            "annealing epoch {:02} temperature {:11.6f} best {:11.6f}", epoch,
+            temperature, best_cost);
+        control.maybe_checkpoint([&] { return best; });
+        if (control.should_stop() || control.reached_target(best_cost)) {
+            spdlog::info("annealing stopped early after {} epochs", epoch + 1);
+            break;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+PartitionSoln
+optift::partition_solve_annealing(const PartitionInstance &instance,
+                                  PartitionSoln initial_soln,
+                                  const AnnealingOptions &options,
+                                  const SolveControl &control) {
+    if (instance.n_partitions < 2 || instance.n_items == 0) {
+        return initial_soln;
+    }
+    PartitionSoln best =
+        visit_cost_model(instance, [&](const auto &cost) {
+            return anneal(instance, initial_soln, options, control, cost);
+        });
+    return partition_refine_fm(instance, std::move(best), control);
+}
@@ -0,0 +1,383 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <range/v3/algorithm/sort.hpp>
+#include <range/v3/numeric/accumulate.hpp>
+#include <range/v3/range/conversion.hpp>
+#include <range/v3/view/iota.hpp>
+#include <range/v3/view/transform.hpp>
+
+using namespace optift;
+
+// The exact solver gives up, keeping the best solution found, after visiting
+// this many nodes of the search tree
+constexpr size_t EXACT_MAX_NODES = 10'000'000;
+// Number of nodes between two checks of the solve control
+constexpr size_t EXACT_CONTROL_INTERVAL = 4096;
+
+namespace {
+
+/**
+ * Lower bounds on partition costs that hold for any cost model, even one that
+ * is not monotone in the size.
+ */
+struct CostBounds {
+    // cost[s] is the cost of a partition of size s
+    std::vector<double> cost;
+    // envelope[s] is the lowest cost of a partition of size at least s, so it
+    // is non-decreasing and a partition that grows never costs less
+    std::vector<double> envelope;
+    // per_glyph[s] is the lowest envelope[a] / a over 1 <= a <= s. A request of
+    // size s split over any partitions costs at least s * per_glyph[s].
+    std::vector<double> per_glyph;
+
+    explicit CostBounds(const PartitionInstance &instance) {
+        const size_t total_size =
+            ranges::accumulate(instance.item_sizes, size_t(0));
+        cost = ranges::views::iota(size_t(0), total_size + 1) |
+               ranges::views::transform(
+                   [&](size_t s) { return instance.cost_model(s); }) |
+               ranges::to<std::vector>();
+        envelope = cost;
+        for (size_t s = total_size; s > 0; s--) {
+            envelope[s - 1] = std::min(envelope[s - 1], envelope[s]);
+        }
+        per_glyph.assign(total_size + 1, 0.0);
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t s = 1; s <= total_size; s++) {
+            best = std::min(best, envelope[s] / static_cast<double>(s));
+            per_glyph[s] = best;
+        }
+    }
+
+    /// Lower bound on the cost of a request of the given size.
+    double request(size_t size) const {
+        return static_cast<double>(size) * per_glyph[size];
+    }
+};
+
+/// Total size of the items of each request.
+std::vector<size_t> request_sizes(const PartitionInstance &instance) {
+    std::vector<size_t> sizes(instance.n_requests(), 0);
+    for (size_t u = 0; u < instance.n_requests(); u++) {
+        for (const size_t x : instance.request_items.row(u)) {
+            sizes[u] += instance.item_sizes[x];
+        }
+    }
+    return sizes;
+}
+
+/**
+ * Lower bound on the sum over partitions of their size times the weight of
+ * the requests using them, for solutions with n_partitions partitions. The
+ * weight of a partition is at least the request weight of each of its items.
+ * With that relaxation, some optimal solution groups the items in order of
+ * decreasing weight into contiguous runs, and a run costs its size times the
+ * weight of its first item. The best runs are found by dynamic programming.
+ */
+double size_weight_bound(const PartitionInstance &instance) {
+    std::vector<double> item_weights(instance.n_items, 0.0);
+    for (size_t x = 0; x < instance.n_items; x++) {
+        for (const size_t u : instance.item_requests.row(x)) {
+            item_weights[x] += instance.weights[u];
+        }
+    }
+    std::vector<size_t> order =
+        ranges::views::iota(size_t(0), instance.n_items) |
+        ranges::to<std::vector>();
+    ranges::sort(order, std::greater<>{},
+                 [&](size_t x) { return item_weights[x]; });
+    const size_t n = order.size();
+    // prefix[j] is the total size of the first j items
+    std::vector<double> prefix(n + 1, 0.0);
+    for (size_t j = 0; j < n; j++) {
+        prefix[j + 1] =
+            prefix[j] + static_cast<double>(instance.item_sizes[order[j]]);
+    }
+
+    // A run of items i + 1..j costs w * (prefix[j] - prefix[i]) with w the
+    // weight of item i + 1. For a fixed start, the cost of the first j items
+    // is thus a line in prefix[j]. Slopes decrease with the start and queries
+    // increase with j, so the lower envelope of the lines is kept in a stack
+    // and scanned with a pointer.
+    struct Line {
+        double slope;
+        double intercept;
+        double at(double x) const { return slope * x + intercept; }
+    };
+    // Whether b is nowhere below both a and c, with slopes a > b > c
+    const auto redundant = [](const Line &a, const Line &b, const Line &c) {
+        return (c.intercept - a.intercept) * (a.slope - b.slope) <=
+               (b.intercept - a.intercept) * (a.slope - c.slope);
+    };
+
+    // best[j] is the lowest cost of the first j items in at most k runs
+    std::vector<double> best(n + 1);
+    for (size_t j = 0; j <= n; j++) {
+        best[j] = j == 0 ? 0.0 : item_weights[order[0]] * prefix[j];
+    }
+    std::vector<double> next(n + 1);
+    std::vector<Line> hull;
+    for (size_t k = 2; k <= instance.n_partitions && k <= n; k++) {
+        hull.clear();
+        size_t front = 0;
+        next[0] = 0.0;
+        for (size_t j = 1; j <= n; j++) {
+            const double w = item_weights[order[j - 1]];
+            const Line line{w, best[j - 1] - w * prefix[j - 1]};
+            if (hull.empty() || hull.back().slope != w ||
+                line.intercept < hull.back().intercept) {
+                if (!hull.empty() && hull.back().slope == w) {
+                    hull.pop_back();
+                }
+                while (hull.size() >= 2 &&
+                       redundant(hull[hull.size() - 2], hull.back(), line)) {
+                    hull.pop_back();
+                }
+                hull.push_back(line);
+            }
+            front = std::min(front, hull.size() - 1);
+            while (front + 1 < hull.size() &&
+                   hull[front + 1].at(prefix[j]) <= hull[front].at(prefix[j])) {
+                front++;
+            }
+            next[j] = std::min(best[j], hull[front].at(prefix[j]));
+        }
+        std::swap(best, next);
+    }
+    return n == 0 ? 0.0 : best[n];
+}
+
+/**
+ * Depth-first branch and bound over item assignments. Items are assigned in
+ * order of decreasing request weight, so that the bound rises early, and an
+ * item may only open the first empty partition, since partitions are
+ * interchangeable.
+ *
+ * The bound of a node is the cost of the assigned items alone, with partition
+ * costs from \ref CostBounds::envelope, plus the per-request bound of requests
+ * that have no assigned item yet. Both parts only grow as items are assigned.
+ */
+class BranchAndBound {
+  public:
+    BranchAndBound(const PartitionInstance &instance, PartitionSoln incumbent,
+                   const SolveControl &control)
+        : instance{instance}, control{control}, bounds{instance},
+          n_parts{instance.n_partitions},
+          part_sizes(instance.n_partitions, 0),
+          part_weights(instance.n_partitions, 0.0),
+          overlap(instance.n_requests() * instance.n_partitions, 0),
+          n_assigned(instance.n_requests(), 0),
+          assignment(instance.n_items, 0),
+          best_cost{instance.eval(incumbent)}, best{std::move(incumbent)} {
+        std::vector<double> item_weights(instance.n_items, 0.0);
+        for (size_t x = 0; x < instance.n_items; x++) {
+            for (const size_t u : instance.item_requests.row(x)) {
+                item_weights[x] += instance.weights[u];
+            }
+        }
+        order = ranges::views::iota(size_t(0), instance.n_items) |
+                ranges::to<std::vector>();
+        ranges::sort(order, [&](size_t a, size_t b) {
+            return std::pair{-item_weights[a], a} <
+                   std::pair{-item_weights[b], b};
+        });
+
+        const std::vector<size_t> sizes = request_sizes(instance);
+        request_bounds.resize(instance.n_requests());
+        for (size_t u = 0; u < instance.n_requests(); u++) {
+            request_bounds[u] = instance.weights[u] * bounds.request(sizes[u]);
+            untouched_bound += request_bounds[u];
+        }
+    }
+
+    /**
+     * Runs the search.
+     *
+     * \return The best solution found, and whether the search completed, i.e.
+     *   whether that solution is optimal
+     */
+    std::pair<PartitionSoln, bool> run() && {
+        search(0, 0);
+        spdlog::debug("exact solver: {} nodes, cost {}", n_nodes, best_cost);
+        return {std::move(best), !stopped};
+    }
+
+  private:
+    const PartitionInstance &instance;
+    const SolveControl &control;
+    const CostBounds bounds;
+    const size_t n_parts;
+
+    // Items in the order they are assigned
+    std::vector<size_t> order;
+    std::vector<size_t> part_sizes;
+    // Total weight of the requests using each partition so far
+    std::vector<double> part_weights;
+    // overlap[u * n_parts + k] is the number of assigned items of request u
+    // in partition k
+    std::vector<size_t> overlap;
+    // Number of assigned items of each request
+    std::vector<size_t> n_assigned;
+    // Weighted lower bound on the cost of each request
+    std::vector<double> request_bounds;
+    // Sum of request_bounds over requests with no assigned items
+    double untouched_bound = 0.0;
+    std::vector<size_t> assignment;
+
+    double best_cost;
+    PartitionSoln best;
+    size_t n_nodes = 0;
+    bool stopped = false;
+
+    double bound(size_t n_used) const {
+        double total = untouched_bound;
+        for (size_t k = 0; k < n_used; k++) {
+            total += bounds.envelope[part_sizes[k]] * part_weights[k];
+        }
+        return total;
+    }
+
+    /// Cost of a complete assignment.
+    double cost(size_t n_used) const {
+        double total = 0.0;
+        for (size_t k = 0; k < n_used; k++) {
+            total += bounds.cost[part_sizes[k]] * part_weights[k];
+        }
+        return total;
+    }
+
+    /// Assigns item x to partition k. Sums are not undone by subtraction
+    /// but restored by the caller, so that they do not drift.
+    void assign(size_t x, size_t k) {
+        assignment[x] = k;
+        part_sizes[k] += instance.item_sizes[x];
+        for (const size_t u : instance.item_requests.row(x)) {
+            if (overlap[u * n_parts + k]++ == 0) {
+                part_weights[k] += instance.weights[u];
+            }
+            if (n_assigned[u]++ == 0) {
+                untouched_bound -= request_bounds[u];
+            }
+        }
+    }
+
+    void unassign(size_t x, size_t k, double weight, double untouched) {
+        part_sizes[k] -= instance.item_sizes[x];
+        for (const size_t u : instance.item_requests.row(x)) {
+            overlap[u * n_parts + k]--;
+            n_assigned[u]--;
+        }
+        part_weights[k] = weight;
+        untouched_bound = untouched;
+    }
+
+    void search(size_t depth, size_t n_used) {
+        if (stopped) {
+            return;
+        }
+        if (++n_nodes % EXACT_CONTROL_INTERVAL == 0 &&
+            (control.should_stop() || n_nodes >= EXACT_MAX_NODES)) {
+            stopped = true;
+            return;
+        }
+        if (depth == order.size()) {
+            if (const double c = cost(n_used); c < best_cost) {
+                best_cost = c;
+                best = {.n_partitions = n_parts,
+                        .item_to_partition = assignment};
+                // Good enough, although not proven optimal
+                stopped = control.reached_target(best_cost);
+            }
+            return;
+        }
+
+        // Children are visited in order of their bound, so that good
+        // solutions are found early and prune the rest
+        const size_t x = order[depth];
+        const size_t n_children = std::min(n_used + 1, n_parts);
+        std::vector<std::pair<double, size_t>> children;
+        for (size_t k = 0; k < n_children; k++) {
+            const double weight = part_weights[k];
+            const double untouched = untouched_bound;
+            assign(x, k);
+            children.emplace_back(bound(std::max(n_used, k + 1)), k);
+            unassign(x, k, weight, untouched);
+        }
+        ranges::sort(children);
+        for (const auto &[child_bound, k] : children) {
+            if (child_bound >= best_cost) {
+                break;
+            }
+            const double weight = part_weights[k];
+            const double untouched = untouched_bound;
+            assign(x, k);
+            search(depth + 1, std::max(n_used, k + 1));
+            unassign(x, k, weight, untouched);
+        }
+    }
+};
+
+} // namespace
+
+double PartitionInstance::lower_bound() const {
+    const CostBounds bounds{*this};
+    const std::vector<size_t> sizes = request_sizes(*this);
+    double per_request = 0.0;
+    double used_weight = 0.0;
+    for (size_t u = 0; u < n_requests(); u++) {
+        per_request += weights[u] * bounds.request(sizes[u]);
+        if (sizes[u] > 0) {
+            used_weight += weights[u];
+        }
+    }
+
+    // With a line a + b * s below the cost of every non-empty partition, the
+    // cost is at least a times the total weight of the partitions, which is at
+    // least used_weight, plus b times the bound of size_weight_bound. Lines
+    // are tried with the slopes of the envelope over doubling sizes.
+    const size_t total_size = bounds.envelope.size() - 1;
+    const double size_weight = size_weight_bound(*this);
+    double per_partition = 0.0;
+    for (size_t s = 1; s <= total_size; s *= 2) {
+        const size_t t = std::min(2 * s, total_size);
+        const double slope =
+            t > s ? std::max(0.0, (bounds.envelope[t] - bounds.envelope[s]) /
+                                      static_cast<double>(t - s))
+                  : 0.0;
+        double intercept = std::numeric_limits<double>::infinity();
+        for (size_t a = 1; a <= total_size; a++) {
+            intercept =
+                std::min(intercept, bounds.envelope[a] -
+                                        slope * static_cast<double>(a));
+        }
+        // A request uses at most n_partitions partitions
+        const double partitions_weight =
+            intercept >= 0.0
+                ? used_weight
+                : used_weight * static_cast<double>(n_partitions);
+        per_partition =
+            std::max(per_partition,
+                     intercept * partitions_weight + slope * size_weight);
+    }
+    return std::max(per_request, per_partition);
+}
+
+std::pair<PartitionSoln, bool>
+optift::partition_solve_exact(const PartitionInstance &instance,
+                              PartitionSoln incumbent,
+                              const SolveControl &control) {
+    auto [soln, optimal] =
+        BranchAndBound{instance, std::move(incumbent), control}.run();
+    if (!optimal) {
+        spdlog::info("exact solver stopped early");
+    }
+    return {std::move(soln), optimal};
+}
@@ -0,0 +1,148 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+using namespace optift;
+
+ChangeCost ChangeCost::from_previous(const PartitionInstance &instance,
+                                     std::vector<size_t> previous,
+                                     std::vector<double> partition_bytes,
+                                     double penalty) {
+    const size_t n_previous = partition_bytes.size();
+    if (previous.size() != instance.n_items) {
+        throw std::runtime_error(
+            fmt::format("invalid previous solution: expected {} items, got {}",
+                        instance.n_items, previous.size()));
+    }
+    for (const size_t k : previous) {
+        if (k != NEW && k >= n_previous) {
+            throw std::runtime_error(fmt::format(
+                "invalid previous partition {} of {}", k, n_previous));
+        }
+    }
+
+    // Weight of the requests that used each previous partition
+    std::vector<double> partition_weights(n_previous, 0.0);
+    std::vector<size_t> seen(n_previous, 0);
+    for (size_t u = 0; u < instance.n_requests(); u++) {
+        for (const size_t x : instance.request_items.row(u)) {
+            // Stamps are unique per request, so seen needs no reset
+            if (const size_t k = previous[x]; k != NEW && seen[k] != u + 1) {
+                seen[k] = u + 1;
+                partition_weights[k] += instance.weights[u];
+            }
+        }
+    }
+    std::vector<double> partition_costs(n_previous);
+    for (size_t k = 0; k < n_previous; k++) {
+        partition_costs[k] =
+            penalty * partition_bytes[k] * partition_weights[k];
+    }
+    return {
+        .previous = std::move(previous),
+        .partition_bytes = std::move(partition_bytes),
+        .partition_costs = std::move(partition_costs),
+    };
+}
+
+PartitionSoln ChangeCost::warm_start(size_t n_partitions) const {
+    if (n_partitions <= partition_bytes.size()) {
+        throw std::runtime_error(
+            fmt::format("a warm start from {} partitions needs more than {}",
+                        partition_bytes.size(), n_partitions));
+    }
+    PartitionSoln soln{
+        .n_partitions = n_partitions,
+        .item_to_partition = previous,
+    };
+    for (size_t &k : soln.item_to_partition) {
+        if (k == NEW) {
+            k = n_partitions - 1;
+        }
+    }
+    return soln;
+}
+
+std::vector<size_t> PartitionInstance::change_mismatches(
+    std::span<const size_t> item_to_partition, size_t n_partitions) const {
+    // Also covers the previous partitions if the solution has fewer
+    std::vector<size_t> mismatches(
+        std::max(n_partitions, change_cost.partition_costs.size()), 0);
+    if (!has_change_cost()) {
+        return mismatches;
+    }
+    for (size_t x = 0; x < n_items; x++) {
+        const size_t k = item_to_partition[x];
+        const size_t previous = change_cost.previous[x];
+        if (k != previous) {
+            // x joined k, and left its previous partition
+            mismatches[k]++;
+            if (previous != ChangeCost::NEW) {
+                mismatches[previous]++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+double PartitionInstance::eval_changes(const PartitionSoln &soln) const {
+    const std::vector<size_t> mismatches =
+        change_mismatches(soln.item_to_partition, soln.n_partitions);
+    double total = 0.0;
+    for (size_t k = 0; k < change_cost.partition_costs.size(); k++) {
+        if (mismatches[k] > 0) {
+            total += change_cost.partition_costs[k];
+        }
+    }
+    return total;
+}
+
+double PartitionInstance::changed_bytes(const PartitionSoln &soln) const {
+    const std::vector<size_t> mismatches =
+        change_mismatches(soln.item_to_partition, soln.n_partitions);
+    double total = 0.0;
+    for (size_t k = 0; k < change_cost.partition_bytes.size(); k++) {
+        if (mismatches[k] > 0) {
+            total += change_cost.partition_bytes[k];
+        }
+    }
+    return total;
+}
+
+PartitionSoln optift::partition_limit_changes(
+    const PartitionInstance &instance, PartitionSoln soln,
+    const std::function<PartitionSoln(const PartitionInstance &,
+                                      PartitionSoln)> &solve,
+    double max_changed_bytes, const SolveControl &control,
+    size_t max_rounds) {
+    if (!instance.has_change_cost() ||
+        instance.changed_bytes(soln) <= max_changed_bytes) {
+        return soln;
+    }
+    const PartitionSoln start =
+        instance.change_cost.warm_start(instance.n_partitions);
+    PartitionInstance penalized = instance;
+    for (size_t round = 0; round < max_rounds && !control.should_stop();
+         round++) {
+        for (double &cost : penalized.change_cost.partition_costs) {
+            cost *= 2;
+        }
+        soln = solve(penalized, start);
+        const double changed = instance.changed_bytes(soln);
+        spdlog::info("change round {}: {} bytes changed, cost {}", round,
+                     changed, instance.eval(soln));
+        if (changed <= max_changed_bytes) {
+            return soln;
+        }
+    }
+    spdlog::warn("could not keep changes within {} bytes, keeping the "
+                 "previous partitions",
+                 max_changed_bytes);
+    return start;
+}
@@ -0,0 +1,205 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <range/v3/algorithm/equal.hpp>
+#include <range/v3/algorithm/lexicographical_compare.hpp>
+#include <range/v3/algorithm/sort.hpp>
+#include <range/v3/range/conversion.hpp>
+#include <range/v3/view/iota.hpp>
+#include <range/v3/view/transform.hpp>
+
+using namespace optift;
+
+namespace {
+
+/// FNV-1a hash of a CSR row, used to bucket identical rows quickly.
+uint64_t hash_row(std::span<const size_t> row) {
+    constexpr uint64_t FNV1A_HASH_BASIS = 14695981039346656037ULL;
+    constexpr uint64_t FNV1A_HASH_PRIME = 1099511628211ULL;
+    uint64_t hash = FNV1A_HASH_BASIS;
+    for (const size_t x : row) {
+        hash ^= x;
+        hash *= FNV1A_HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Groups identical rows of a CSR matrix.
+ *
+ * \return A pair of a vector mapping each row to its group, and the number of
+ *   groups. Groups are numbered in order of their first row, so the mapping is
+ *   deterministic.
+ */
+std::pair<std::vector<size_t>, size_t> group_rows(const CsrMatrix &m) {
+    const std::vector<uint64_t> hashes =
+        ranges::views::iota(size_t(0), m.n_rows()) |
+        ranges::views::transform([&](size_t i) { return hash_row(m.row(i)); }) |
+        ranges::to<std::vector>();
+    // Sort by hash, then by content, so identical rows are adjacent
+    std::vector<size_t> order =
+        ranges::views::iota(size_t(0), m.n_rows()) | ranges::to<std::vector>();
+    ranges::sort(order, [&](size_t a, size_t b) {
+        if (hashes[a] != hashes[b]) {
+            return hashes[a] < hashes[b];
+        }
+        if (!ranges::equal(m.row(a), m.row(b))) {
+            return ranges::lexicographical_compare(m.row(a), m.row(b));
+        }
+        return a < b;
+    });
+    // Representative (first row) of the group of each row
+    std::vector<size_t> first(m.n_rows());
+    for (size_t k = 0; k < order.size(); k++) {
+        const bool same_as_prev = k > 0 &&
+                                  hashes[order[k]] == hashes[order[k - 1]] &&
+                                  ranges::equal(m.row(order[k]),
+                                                m.row(order[k - 1]));
+        first[order[k]] = same_as_prev ? first[order[k - 1]] : order[k];
+    }
+    constexpr size_t UNASSIGNED = std::numeric_limits<size_t>::max();
+    std::vector<size_t> group(m.n_rows(), UNASSIGNED);
+    size_t n_groups = 0;
+    for (size_t i = 0; i < m.n_rows(); i++) {
+        if (group[first[i]] == UNASSIGNED) {
+            group[first[i]] = n_groups++;
+        }
+        group[i] = group[first[i]];
+    }
+    return {group, n_groups};
+}
+
+/**
+ * Returns the item to request matrix of an instance with a change cost, with
+ * an extra column per previous partition (and one for new items) after the
+ * requests, so that items of different previous partitions have different
+ * rows.
+ */
+CsrMatrix with_previous_partitions(const PartitionInstance &instance) {
+    const size_t n_previous = instance.change_cost.partition_costs.size();
+    CsrMatrix m;
+    for (size_t x = 0; x < instance.n_items; x++) {
+        const auto row = instance.item_requests.row(x);
+        std::vector<size_t> columns{row.begin(), row.end()};
+        columns.push_back(
+            instance.n_requests() +
+            std::min(instance.change_cost.previous[x], n_previous));
+        m.push_row(std::move(columns));
+    }
+    return m;
+}
+
+} // namespace
+
+PartitionSoln CoarsenedInstance::project(const PartitionSoln &soln) const {
+    return {
+        .n_partitions = soln.n_partitions,
+        .item_to_partition =
+            item_map | ranges::views::transform([&](size_t x) {
+                return soln.item_to_partition[x];
+            }) |
+            ranges::to<std::vector>(),
+    };
+}
+
+PartitionSoln CoarsenedInstance::restrict(const PartitionSoln &soln) const {
+    constexpr size_t UNASSIGNED = std::numeric_limits<size_t>::max();
+    PartitionSoln result{
+        .n_partitions = soln.n_partitions,
+        .item_to_partition =
+            std::vector<size_t>(instance.n_items, UNASSIGNED),
+    };
+    for (size_t x = 0; x < item_map.size(); x++) {
+        if (result.item_to_partition[item_map[x]] == UNASSIGNED) {
+            result.item_to_partition[item_map[x]] = soln.item_to_partition[x];
+        }
+    }
+    return result;
+}
+
+CoarsenedInstance optift::contract_instance(const PartitionInstance &instance,
+                                            std::vector<size_t> item_map,
+                                            size_t n_items) {
+    std::vector<size_t> item_sizes(n_items, 0);
+    for (size_t x = 0; x < instance.n_items; x++) {
+        item_sizes[item_map[x]] += instance.item_sizes[x];
+    }
+
+    // Requests with the same coarse items become one coarse request
+    CsrMatrix mapped_requests;
+    for (size_t u = 0; u < instance.n_requests(); u++) {
+        mapped_requests.push_row(instance.request_items.row(u) |
+                                 ranges::views::transform([&](size_t x) {
+                                     return item_map[x];
+                                 }) |
+                                 ranges::to<std::vector>());
+    }
+    const auto [request_map, n_requests] = group_rows(mapped_requests);
+    std::vector<double> weights(n_requests, 0.0);
+    CsrMatrix request_items;
+    for (size_t u = 0; u < instance.n_requests(); u++) {
+        if (request_map[u] == request_items.n_rows()) {
+            const auto row = mapped_requests.row(u);
+            request_items.push_row({row.begin(), row.end()});
+        }
+        weights[request_map[u]] += instance.weights[u];
+    }
+
+    CoarsenedInstance result{
+        .instance = PartitionInstance::from_csr(
+            instance.n_partitions, n_items, std::move(weights),
+            std::move(request_items), instance.cost_model),
+        .item_map = std::move(item_map),
+    };
+    result.instance.item_sizes = std::move(item_sizes);
+    result.instance.objective = instance.objective;
+    result.instance.min_partition_size = instance.min_partition_size;
+    result.instance.max_partition_size = instance.max_partition_size;
+    // Pairs of consecutive codepoints between items that become one coarse
+    // item join their runs for good
+    std::vector<std::pair<size_t, size_t>> css_pairs;
+    for (size_t x = 0; x < instance.css_cost.neighbors.n_rows(); x++) {
+        for (const size_t y : instance.css_cost.neighbors.row(x)) {
+            if (x < y) {
+                css_pairs.emplace_back(item_map[x], item_map[y]);
+            }
+        }
+    }
+    result.instance.css_cost = CssCost::from_pairs(
+        n_items, css_pairs, instance.css_cost.base_runs,
+        instance.css_cost.bytes_per_run);
+    if (instance.has_change_cost()) {
+        // Exact if merged items come from the same previous partition, as in
+        // coarsen_instance. Otherwise the last one wins.
+        ChangeCost &change_cost = result.instance.change_cost;
+        change_cost = instance.change_cost;
+        change_cost.previous.assign(n_items, ChangeCost::NEW);
+        for (size_t x = 0; x < instance.n_items; x++) {
+            change_cost.previous[result.item_map[x]] =
+                instance.change_cost.previous[x];
+        }
+    }
+    return result;
+}
+
+CoarsenedInstance optift::coarsen_instance(const PartitionInstance &instance) {
+    // Items with the same requests become one coarse item, unless they were in
+    // different partitions of a previous solution
+    auto [item_map, n_items] =
+        instance.has_change_cost()
+            ? group_rows(with_previous_partitions(instance))
+            : group_rows(instance.item_requests);
+    CoarsenedInstance result =
+        contract_instance(instance, std::move(item_map), n_items);
+    spdlog::info("coarsened instance: {} -> {} items, {} -> {} requests",
+                 instance.n_items, result.instance.n_items,
+                 instance.n_requests(), result.instance.n_requests());
+    return result;
+}
@@ -0,0 +1,213 @@
+#include "cost_cache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+using namespace optift;
+
+// Start of every cache file, followed by the format version
+constexpr std::string_view COST_CACHE_MAGIC = "OPTIFTCM";
+// Bumped whenever the format or the meaning of the samples changes
+constexpr uint32_t COST_CACHE_VERSION = 1;
+// Bytes of a sample record: the subset size and its bytes, as uint32 each
+constexpr size_t COST_CACHE_RECORD_SIZE = 8;
+
+namespace {
+
+void put_uint(std::string &out, uint64_t value, size_t n_bytes) {
+    for (size_t i = 0; i < n_bytes; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xffU));
+    }
+}
+
+/// Little-endian reader over the contents of a cache file.
+struct Reader {
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+
+    std::optional<uint64_t> read_uint(size_t n_bytes) {
+        if (n_bytes > data.size() - pos) {
+            return std::nullopt;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < n_bytes; i++) {
+            value |= uint64_t{data[pos + i]} << (8 * i);
+        }
+        pos += n_bytes;
+        return value;
+    }
+
+    /// Reads an unsigned LEB128 varint.
+    std::optional<uint64_t> read_varint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+            const uint8_t byte = data[pos++];
+            value |= uint64_t{byte & 0x7fU} << shift;
+            if ((byte & 0x80U) == 0) {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+void put_varint(std::string &out, uint64_t value) {
+    while (value >= 0x80U) {
+        out.push_back(static_cast<char>((value & 0x7fU) | 0x80U));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/// Header of a cache file: the font hash and the universe, delta-encoded.
+std::string encode_header(uint64_t font_hash,
+                          std::span<const UChar32> codepoints) {
+    std::string out{COST_CACHE_MAGIC};
+    put_uint(out, COST_CACHE_VERSION, 4);
+    put_uint(out, font_hash, 8);
+    put_varint(out, codepoints.size());
+    UChar32 previous = 0;
+    for (const UChar32 c : codepoints) {
+        put_varint(out, static_cast<uint64_t>(c - previous));
+        previous = c;
+    }
+    return out;
+}
+
+struct CacheFile {
+    std::vector<UChar32> codepoints;
+    std::vector<std::pair<size_t, double>> samples;
+    // Length of the header and the complete records
+    size_t valid_length;
+};
+
+/// Reads a cache file, or returns nullopt if it is not a cache file of this
+/// version for the font. A truncated last record is dropped.
+std::optional<CacheFile> read_cache_file(const std::filesystem::path &path,
+                                         uint64_t font_hash) {
+    std::ifstream in{path, std::ios::binary};
+    const std::vector<uint8_t> data{std::istreambuf_iterator<char>{in},
+                                    std::istreambuf_iterator<char>{}};
+    if (data.size() < COST_CACHE_MAGIC.size() ||
+        !std::equal(COST_CACHE_MAGIC.begin(), COST_CACHE_MAGIC.end(),
+                    data.begin())) {
+        return std::nullopt;
+    }
+    Reader reader{.data = data, .pos = COST_CACHE_MAGIC.size()};
+    const auto version = reader.read_uint(4);
+    const auto hash = reader.read_uint(8);
+    const auto n_codepoints = reader.read_varint();
+    if (version != COST_CACHE_VERSION || hash != font_hash || !n_codepoints ||
+        *n_codepoints > data.size()) {
+        return std::nullopt;
+    }
+    CacheFile file;
+    file.codepoints.reserve(*n_codepoints);
+    UChar32 previous = 0;
+    for (uint64_t i = 0; i < *n_codepoints; i++) {
+        const auto delta = reader.read_varint();
+        if (!delta) {
+            return std::nullopt;
+        }
+        previous += static_cast<UChar32>(*delta);
+        file.codepoints.push_back(previous);
+    }
+    while (data.size() - reader.pos >= COST_CACHE_RECORD_SIZE) {
+        const uint64_t n_glyphs = *reader.read_uint(4);
+        const uint64_t bytes = *reader.read_uint(4);
+        file.samples.emplace_back(n_glyphs, static_cast<double>(bytes));
+    }
+    file.valid_length = reader.pos;
+    return file;
+}
+
+/// Jaccard similarity of two sorted sets of codepoints.
+double similarity(std::span<const UChar32> a, std::span<const UChar32> b) {
+    size_t n_common = 0;
+    for (size_t i = 0, j = 0; i < a.size() && j < b.size();) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (b[j] < a[i]) {
+            j++;
+        } else {
+            n_common++;
+            i++;
+            j++;
+        }
+    }
+    const size_t n_union = a.size() + b.size() - n_common;
+    return n_union == 0 ? 1.0
+                        : static_cast<double>(n_common) /
+                              static_cast<double>(n_union);
+}
+
+} // namespace
+
+uint64_t optift::hash_bytes(std::span<const uint8_t> data) {
+    return XXH3_64bits(data.data(), data.size());
+}
+
+CostModelCache::CostModelCache(const std::filesystem::path &dir,
+                               std::span<const uint8_t> font_data,
+                               std::span<const UChar32> codepoints) {
+    const uint64_t font_hash = hash_bytes(font_data);
+    std::filesystem::create_directories(dir);
+
+    // Files of the font are numbered from 0, the first free number is used
+    // for a new one
+    std::optional<CacheFile> best;
+    double best_similarity = MIN_SIMILARITY;
+    size_t n_files = 0;
+    for (;; n_files++) {
+        const std::filesystem::path path =
+            dir / fmt::format("costs-{:016x}-{}.bin", font_hash, n_files);
+        if (!std::filesystem::exists(path)) {
+            break;
+        }
+        auto cache_file = read_cache_file(path, font_hash);
+        if (!cache_file) {
+            spdlog::warn("ignoring invalid cost model cache {}",
+                         path.string());
+            continue;
+        }
+        if (const double s = similarity(cache_file->codepoints, codepoints);
+            s >= best_similarity) {
+            best_similarity = s;
+            best = std::move(cache_file);
+            file_path = path;
+        }
+    }
+
+    if (best) {
+        // Drops a record that an interrupted run only partly wrote
+        std::filesystem::resize_file(file_path, best->valid_length);
+        loaded_samples = std::move(best->samples);
+        file.open(file_path, std::ios::binary | std::ios::app);
+    } else {
+        file_path =
+            dir / fmt::format("costs-{:016x}-{}.bin", font_hash, n_files);
+        file.open(file_path, std::ios::binary | std::ios::trunc);
+        file << encode_header(font_hash, codepoints);
+        file.flush();
+    }
+    if (!file) {
+        throw std::runtime_error(fmt::format(
+            "could not open cost model cache {}", file_path.string()));
+    }
+}
+
+void CostModelCache::append(size_t n_glyphs, double bytes) {
+    std::string record;
+    put_uint(record, n_glyphs, 4);
+    put_uint(record, static_cast<uint64_t>(bytes), 4);
+    file << record;
+    file.flush();
+}
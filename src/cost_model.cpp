@@ -1,6 +1,10 @@
 #include <cost_model.h>
 
 #include <map>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/core.h>
 
 // #include <range/v3/all.hpp>
 #include <range/v3/algorithm/lower_bound.hpp>
@@ -60,3 +64,33 @@ double FontEmpiricalCostModel ::operator()(size_t n_glyphs) const {
                             static_cast<double>(n_glyphs - lb->first) /
                             static_cast<double>(ub->first - lb->first);
 }
+
+TabulatedCostModel::TabulatedCostModel(std::function<double(size_t)> model,
+                                       size_t max_glyphs)
+    : model{std::move(model)}, table(max_glyphs + 1) {
+    for (size_t n = 0; n <= max_glyphs; n++) {
+        table[n] = this->model(n);
+    }
+}
+
+NetworkProfile NetworkProfile::from_name(std::string_view name) {
+    // WebPageTest's connection profiles, in kbit/s and milliseconds
+    constexpr double KBPS = 1000.0 / 8.0;
+    constexpr double MS = 1e-3;
+    // NOLINTBEGIN(*-magic-numbers)
+    if (name == "none") {
+        return {};
+    }
+    if (name == "3g") {
+        return {.rtt_seconds = 300 * MS, .bytes_per_second = 1600 * KBPS};
+    }
+    if (name == "4g") {
+        return {.rtt_seconds = 170 * MS, .bytes_per_second = 9000 * KBPS};
+    }
+    if (name == "cable") {
+        return {.rtt_seconds = 28 * MS, .bytes_per_second = 5000 * KBPS};
+    }
+    // NOLINTEND(*-magic-numbers)
+    throw std::runtime_error(
+        fmt::format("unknown network profile: {}", name));
+}
@@ -0,0 +1,430 @@
+#include "dynamic_bitset.h"
+
+#include <bit>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OPTIFT_BITSET_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace optift;
+using namespace optift::bitset_kernels;
+
+namespace {
+
+struct Kernels {
+    const char *name;
+    size_t (*popcount)(Words a);
+    size_t (*and_popcount)(Words a, Words b);
+    size_t (*or_popcount)(Words a, Words b);
+    bool (*is_disjoint)(Words a, Words b);
+    size_t (*and_into)(Words a, Words b, MutWords out);
+    size_t (*diff_and_into)(Words a, Words b, MutWords diff, MutWords inter);
+    void (*andnot_inplace)(MutWords a, Words b);
+    void (*or_inplace)(MutWords a, Words b);
+};
+
+// Scalar kernels. These are also used for the tails of the vectorized ones.
+
+size_t popcount_scalar(const Word *a, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += std::popcount(a[i]);
+    }
+    return count;
+}
+
+size_t and_popcount_scalar(const Word *a, const Word *b, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += std::popcount(a[i] & b[i]);
+    }
+    return count;
+}
+
+size_t or_popcount_scalar(const Word *a, const Word *b, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += std::popcount(a[i] | b[i]);
+    }
+    return count;
+}
+
+bool is_disjoint_scalar(const Word *a, const Word *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] & b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t and_into_scalar(const Word *a, const Word *b, Word *out, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] & b[i];
+        count += std::popcount(out[i]);
+    }
+    return count;
+}
+
+size_t diff_and_into_scalar(const Word *a, const Word *b, Word *diff,
+                            Word *inter, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        diff[i] = a[i] & ~b[i];
+        inter[i] = a[i] & b[i];
+        count += std::popcount(inter[i]);
+    }
+    return count;
+}
+
+void andnot_inplace_scalar(Word *a, const Word *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        a[i] &= ~b[i];
+    }
+}
+
+void or_inplace_scalar(Word *a, const Word *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        a[i] |= b[i];
+    }
+}
+
+const Kernels SCALAR_KERNELS{
+    .name = "scalar",
+    .popcount = [](Words a) { return popcount_scalar(a.data(), a.size()); },
+    .and_popcount =
+        [](Words a, Words b) {
+            return and_popcount_scalar(a.data(), b.data(), a.size());
+        },
+    .or_popcount =
+        [](Words a, Words b) {
+            return or_popcount_scalar(a.data(), b.data(), a.size());
+        },
+    .is_disjoint =
+        [](Words a, Words b) {
+            return is_disjoint_scalar(a.data(), b.data(), a.size());
+        },
+    .and_into =
+        [](Words a, Words b, MutWords out) {
+            return and_into_scalar(a.data(), b.data(), out.data(), a.size());
+        },
+    .diff_and_into =
+        [](Words a, Words b, MutWords diff, MutWords inter) {
+            return diff_and_into_scalar(a.data(), b.data(), diff.data(),
+                                        inter.data(), a.size());
+        },
+    .andnot_inplace =
+        [](MutWords a, Words b) {
+            andnot_inplace_scalar(a.data(), b.data(), a.size());
+        },
+    .or_inplace =
+        [](MutWords a, Words b) {
+            or_inplace_scalar(a.data(), b.data(), a.size());
+        },
+};
+
+#ifdef OPTIFT_BITSET_X86
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+
+// AVX2 has no vector popcount, so we count bits per nibble with a shuffle
+// lookup and sum the bytes with SAD (Mula et al.).
+
+#define OPTIFT_AVX2 __attribute__((target("avx2,popcnt")))
+
+OPTIFT_AVX2 inline __m256i popcount_epi64_avx2(__m256i v) {
+    const __m256i lookup =
+        _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                         1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(v, low_mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                        _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+OPTIFT_AVX2 inline size_t hsum_epi64_avx2(__m256i v) {
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+OPTIFT_AVX2 inline __m256i load_avx2(const Word *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+OPTIFT_AVX2 inline void store_avx2(Word *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+
+constexpr size_t AVX2_WORDS = 4;
+
+OPTIFT_AVX2 size_t popcount_avx2(Words a) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        acc = _mm256_add_epi64(acc, popcount_epi64_avx2(load_avx2(&a[i])));
+    }
+    return hsum_epi64_avx2(acc) + popcount_scalar(a.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 size_t and_popcount_avx2(Words a, Words b) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        const __m256i v = _mm256_and_si256(load_avx2(&a[i]), load_avx2(&b[i]));
+        acc = _mm256_add_epi64(acc, popcount_epi64_avx2(v));
+    }
+    return hsum_epi64_avx2(acc) +
+           and_popcount_scalar(a.data() + n, b.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 size_t or_popcount_avx2(Words a, Words b) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        const __m256i v = _mm256_or_si256(load_avx2(&a[i]), load_avx2(&b[i]));
+        acc = _mm256_add_epi64(acc, popcount_epi64_avx2(v));
+    }
+    return hsum_epi64_avx2(acc) +
+           or_popcount_scalar(a.data() + n, b.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 bool is_disjoint_avx2(Words a, Words b) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        if (!_mm256_testz_si256(load_avx2(&a[i]), load_avx2(&b[i]))) {
+            return false;
+        }
+    }
+    return is_disjoint_scalar(a.data() + n, b.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 size_t and_into_avx2(Words a, Words b, MutWords out) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        const __m256i v = _mm256_and_si256(load_avx2(&a[i]), load_avx2(&b[i]));
+        store_avx2(&out[i], v);
+        acc = _mm256_add_epi64(acc, popcount_epi64_avx2(v));
+    }
+    return hsum_epi64_avx2(acc) +
+           and_into_scalar(a.data() + n, b.data() + n, out.data() + n,
+                           a.size() - n);
+}
+
+OPTIFT_AVX2 size_t diff_and_into_avx2(Words a, Words b, MutWords diff,
+                                      MutWords inter) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        const __m256i va = load_avx2(&a[i]);
+        const __m256i vb = load_avx2(&b[i]);
+        const __m256i v = _mm256_and_si256(va, vb);
+        store_avx2(&diff[i], _mm256_andnot_si256(vb, va));
+        store_avx2(&inter[i], v);
+        acc = _mm256_add_epi64(acc, popcount_epi64_avx2(v));
+    }
+    return hsum_epi64_avx2(acc) +
+           diff_and_into_scalar(a.data() + n, b.data() + n, diff.data() + n,
+                                inter.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 void andnot_inplace_avx2(MutWords a, Words b) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        store_avx2(&a[i], _mm256_andnot_si256(load_avx2(&b[i]), //
+                                              load_avx2(&a[i])));
+    }
+    andnot_inplace_scalar(a.data() + n, b.data() + n, a.size() - n);
+}
+
+OPTIFT_AVX2 void or_inplace_avx2(MutWords a, Words b) {
+    const size_t n = a.size() / AVX2_WORDS * AVX2_WORDS;
+    for (size_t i = 0; i < n; i += AVX2_WORDS) {
+        store_avx2(&a[i], _mm256_or_si256(load_avx2(&a[i]), load_avx2(&b[i])));
+    }
+    or_inplace_scalar(a.data() + n, b.data() + n, a.size() - n);
+}
+
+const Kernels AVX2_KERNELS{
+    .name = "avx2",
+    .popcount = popcount_avx2,
+    .and_popcount = and_popcount_avx2,
+    .or_popcount = or_popcount_avx2,
+    .is_disjoint = is_disjoint_avx2,
+    .and_into = and_into_avx2,
+    .diff_and_into = diff_and_into_avx2,
+    .andnot_inplace = andnot_inplace_avx2,
+    .or_inplace = or_inplace_avx2,
+};
+
+// AVX-512 kernels use the native 64-bit popcount (VPOPCNTDQ) and masked loads
+// and stores for the tail, so there is no scalar epilogue.
+
+#define OPTIFT_AVX512 __attribute__((target("avx512f,avx512vpopcntdq")))
+
+constexpr size_t AVX512_WORDS = 8;
+
+OPTIFT_AVX512 inline __mmask8 tail_mask_avx512(size_t n, size_t i) {
+    const size_t rem = n - i;
+    return rem >= AVX512_WORDS ? static_cast<__mmask8>(0xff)
+                               : static_cast<__mmask8>((1U << rem) - 1);
+}
+
+OPTIFT_AVX512 inline __m512i load_avx512(__mmask8 m, const Word *p) {
+    return _mm512_maskz_loadu_epi64(m, p);
+}
+
+OPTIFT_AVX512 size_t popcount_avx512(Words a) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(load_avx512(m, &a[i])));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+OPTIFT_AVX512 size_t and_popcount_avx512(Words a, Words b) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        const __m512i v =
+            _mm512_and_si512(load_avx512(m, &a[i]), load_avx512(m, &b[i]));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+OPTIFT_AVX512 size_t or_popcount_avx512(Words a, Words b) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        const __m512i v =
+            _mm512_or_si512(load_avx512(m, &a[i]), load_avx512(m, &b[i]));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+OPTIFT_AVX512 bool is_disjoint_avx512(Words a, Words b) {
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        if (_mm512_test_epi64_mask(load_avx512(m, &a[i]),
+                                   load_avx512(m, &b[i])) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+OPTIFT_AVX512 size_t and_into_avx512(Words a, Words b, MutWords out) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        const __m512i v =
+            _mm512_and_si512(load_avx512(m, &a[i]), load_avx512(m, &b[i]));
+        _mm512_mask_storeu_epi64(&out[i], m, v);
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+OPTIFT_AVX512 size_t diff_and_into_avx512(Words a, Words b, MutWords diff,
+                                          MutWords inter) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        const __m512i va = load_avx512(m, &a[i]);
+        const __m512i vb = load_avx512(m, &b[i]);
+        const __m512i v = _mm512_and_si512(va, vb);
+        _mm512_mask_storeu_epi64(&diff[i], m, _mm512_andnot_si512(vb, va));
+        _mm512_mask_storeu_epi64(&inter[i], m, v);
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+OPTIFT_AVX512 void andnot_inplace_avx512(MutWords a, Words b) {
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        _mm512_mask_storeu_epi64(
+            &a[i], m,
+            _mm512_andnot_si512(load_avx512(m, &b[i]), load_avx512(m, &a[i])));
+    }
+}
+
+OPTIFT_AVX512 void or_inplace_avx512(MutWords a, Words b) {
+    for (size_t i = 0; i < a.size(); i += AVX512_WORDS) {
+        const __mmask8 m = tail_mask_avx512(a.size(), i);
+        _mm512_mask_storeu_epi64(
+            &a[i], m,
+            _mm512_or_si512(load_avx512(m, &a[i]), load_avx512(m, &b[i])));
+    }
+}
+
+const Kernels AVX512_KERNELS{
+    .name = "avx512",
+    .popcount = popcount_avx512,
+    .and_popcount = and_popcount_avx512,
+    .or_popcount = or_popcount_avx512,
+    .is_disjoint = is_disjoint_avx512,
+    .and_into = and_into_avx512,
+    .diff_and_into = diff_and_into_avx512,
+    .andnot_inplace = andnot_inplace_avx512,
+    .or_inplace = or_inplace_avx512,
+};
+
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+
+#endif
+
+const Kernels &select_kernels() {
+#ifdef OPTIFT_BITSET_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512vpopcntdq")) {
+        return AVX512_KERNELS;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_KERNELS;
+    }
+#endif
+    return SCALAR_KERNELS;
+}
+
+const Kernels &kernels() {
+    static const Kernels &selected = select_kernels();
+    return selected;
+}
+
+} // namespace
+
+namespace optift::bitset_kernels {
+
+size_t popcount(Words a) { return kernels().popcount(a); }
+
+size_t and_popcount(Words a, Words b) { return kernels().and_popcount(a, b); }
+
+size_t or_popcount(Words a, Words b) { return kernels().or_popcount(a, b); }
+
+bool is_disjoint(Words a, Words b) { return kernels().is_disjoint(a, b); }
+
+size_t and_into(Words a, Words b, MutWords out) {
+    return kernels().and_into(a, b, out);
+}
+
+size_t diff_and_into(Words a, Words b, MutWords diff, MutWords inter) {
+    return kernels().diff_and_into(a, b, diff, inter);
+}
+
+void andnot_inplace(MutWords a, Words b) { kernels().andnot_inplace(a, b); }
+
+void or_inplace(MutWords a, Words b) { kernels().or_inplace(a, b); }
+
+const char *implementation() { return kernels().name; }
+
+} // namespace optift::bitset_kernels
@@ -0,0 +1,264 @@
+#include "glyph_outlines.h"
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "hb_wrap.h"
+
+using namespace optift;
+
+// Components of composite glyphs nested deeper than this are not counted,
+// which also stops cycles in malformed fonts
+constexpr int GLYF_MAX_COMPONENT_DEPTH = 8;
+
+namespace {
+
+/// Big-endian reader over the data of a font table, which throws on reads
+/// past its end.
+class TableReader {
+  public:
+    TableReader(std::span<const uint8_t> data, std::string_view name)
+        : data{data}, name{name} {}
+
+    size_t size() const { return data.size(); }
+
+    /// Reads an unsigned integer of n_bytes bytes at offset.
+    uint32_t read(size_t offset, size_t n_bytes) const {
+        if (offset > data.size() || n_bytes > data.size() - offset) {
+            throw malformed();
+        }
+        uint32_t value = 0;
+        for (size_t i = 0; i < n_bytes; i++) {
+            value = (value << 8U) | data[offset + i];
+        }
+        return value;
+    }
+
+    uint16_t u16(size_t offset) const {
+        return static_cast<uint16_t>(read(offset, 2));
+    }
+
+    std::runtime_error malformed() const {
+        return std::runtime_error(fmt::format("malformed {} table", name));
+    }
+
+  private:
+    std::span<const uint8_t> data;
+    std::string_view name;
+};
+
+/// A table of a face, which is empty if the face does not have it.
+struct Table {
+    BlobPtr blob;
+    TableReader reader;
+
+    Table(hb_face_t *face, hb_tag_t tag, std::string_view name)
+        : blob{hb_face_reference_table(face, tag)},
+          reader{bytes(blob.get()), name} {}
+
+  private:
+    static std::span<const uint8_t> bytes(hb_blob_t *blob) {
+        unsigned int length = 0;
+        const char *const data = hb_blob_get_data(blob, &length);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        return {reinterpret_cast<const uint8_t *>(data), length};
+    }
+};
+
+std::vector<size_t> read_glyf_sizes(const TableReader &glyf,
+                                    const TableReader &loca,
+                                    bool long_offsets, size_t n_glyphs) {
+    // See the glyf table of the OpenType specification
+    constexpr size_t GLYF_HEADER_SIZE = 10;
+    constexpr uint16_t ARG_1_AND_2_ARE_WORDS = 0x0001;
+    constexpr uint16_t WE_HAVE_A_SCALE = 0x0008;
+    constexpr uint16_t MORE_COMPONENTS = 0x0020;
+    constexpr uint16_t WE_HAVE_AN_X_AND_Y_SCALE = 0x0040;
+    constexpr uint16_t WE_HAVE_A_TWO_BY_TWO = 0x0080;
+
+    std::vector<size_t> starts(n_glyphs + 1);
+    for (size_t g = 0; g <= n_glyphs; g++) {
+        starts[g] = long_offsets ? loca.read(4 * g, 4)
+                                 : size_t(2) * loca.u16(2 * g);
+        if (starts[g] > glyf.size() || (g > 0 && starts[g] < starts[g - 1])) {
+            throw loca.malformed();
+        }
+    }
+    const auto size_of = [&](auto &self, size_t g, int depth) -> size_t {
+        size_t size = starts[g + 1] - starts[g];
+        // A negative number of contours marks a composite glyph
+        if (size < GLYF_HEADER_SIZE || depth >= GLYF_MAX_COMPONENT_DEPTH ||
+            static_cast<int16_t>(glyf.u16(starts[g])) >= 0) {
+            return size;
+        }
+        for (size_t pos = starts[g] + GLYF_HEADER_SIZE;;) {
+            const uint16_t flags = glyf.u16(pos);
+            const uint16_t component = glyf.u16(pos + 2);
+            if (component < n_glyphs) {
+                size += self(self, component, depth + 1);
+            }
+            pos += (flags & ARG_1_AND_2_ARE_WORDS) != 0 ? 8 : 6;
+            if ((flags & WE_HAVE_A_SCALE) != 0) {
+                pos += 2;
+            } else if ((flags & WE_HAVE_AN_X_AND_Y_SCALE) != 0) {
+                pos += 4;
+            } else if ((flags & WE_HAVE_A_TWO_BY_TWO) != 0) {
+                pos += 8;
+            }
+            if ((flags & MORE_COMPONENTS) == 0) {
+                break;
+            }
+        }
+        return size;
+    };
+    std::vector<size_t> sizes(n_glyphs);
+    for (size_t g = 0; g < n_glyphs; g++) {
+        sizes[g] = size_of(size_of, g, 0);
+    }
+    return sizes;
+}
+
+/**
+ * Reads a CFF INDEX.
+ *
+ * \return The offsets of its entries in the table followed by the end of the
+ *   INDEX, so that entry i is between the offsets i and i + 1
+ */
+std::vector<size_t> read_cff_index(const TableReader &cff, size_t offset) {
+    const size_t count = cff.u16(offset);
+    if (count == 0) {
+        return {offset + 2};
+    }
+    const size_t off_size = cff.read(offset + 2, 1);
+    if (off_size < 1 || off_size > 4) {
+        throw cff.malformed();
+    }
+    // Offsets count from 1 at the byte before the data
+    const size_t data_start = offset + 3 + (count + 1) * off_size - 1;
+    std::vector<size_t> offsets(count + 1);
+    for (size_t i = 0; i <= count; i++) {
+        offsets[i] = data_start + cff.read(offset + 3 + i * off_size, off_size);
+        if (offsets[i] > cff.size() || (i > 0 && offsets[i] < offsets[i - 1])) {
+            throw cff.malformed();
+        }
+    }
+    return offsets;
+}
+
+/// Returns the offset of the CharStrings INDEX from a CFF Top DICT between
+/// begin and end, if it has one.
+std::optional<size_t> read_charstrings_offset(const TableReader &cff,
+                                              size_t begin, size_t end) {
+    // See the Compact Font Format specification, Table 3 and Table 9
+    constexpr uint32_t MAX_OPERATOR = 21;
+    constexpr uint32_t ESCAPE = 12;
+    constexpr uint32_t CHARSTRINGS = 17;
+    std::optional<int64_t> operand;
+    for (size_t pos = begin; pos < end;) {
+        // NOLINTBEGIN(*-magic-numbers)
+        const auto b0 = static_cast<int64_t>(cff.read(pos, 1));
+        if (b0 <= MAX_OPERATOR) {
+            if (b0 == CHARSTRINGS && operand) {
+                return static_cast<size_t>(*operand);
+            }
+            pos += b0 == ESCAPE ? 2 : 1;
+            operand.reset();
+        } else if (b0 == 28) {
+            operand = static_cast<int16_t>(cff.u16(pos + 1));
+            pos += 3;
+        } else if (b0 == 29) {
+            operand = static_cast<int32_t>(cff.read(pos + 1, 4));
+            pos += 5;
+        } else if (b0 == 30) {
+            // Real number, as nibbles up to an 0xf one
+            for (pos++;; pos++) {
+                const uint32_t b = cff.read(pos, 1);
+                if ((b >> 4U) == 0xf || (b & 0xfU) == 0xf) {
+                    break;
+                }
+            }
+            pos++;
+            operand = 0;
+        } else if (b0 >= 32 && b0 <= 246) {
+            operand = b0 - 139;
+            pos++;
+        } else if (b0 >= 247 && b0 <= 250) {
+            operand = (b0 - 247) * 256 + cff.read(pos + 1, 1) + 108;
+            pos += 2;
+        } else if (b0 >= 251 && b0 <= 254) {
+            operand = -(b0 - 251) * 256 - cff.read(pos + 1, 1) - 108;
+            pos += 2;
+        } else {
+            throw cff.malformed();
+        }
+        // NOLINTEND(*-magic-numbers)
+    }
+    return std::nullopt;
+}
+
+std::vector<size_t> read_cff_sizes(const TableReader &cff, size_t n_glyphs) {
+    const size_t header_size = cff.read(2, 1);
+    const std::vector<size_t> names = read_cff_index(cff, header_size);
+    const std::vector<size_t> top_dicts = read_cff_index(cff, names.back());
+    if (top_dicts.size() < 2) {
+        throw cff.malformed();
+    }
+    const auto charstrings =
+        read_charstrings_offset(cff, top_dicts[0], top_dicts[1]);
+    if (!charstrings) {
+        throw cff.malformed();
+    }
+    const std::vector<size_t> offsets = read_cff_index(cff, *charstrings);
+    if (offsets.size() != n_glyphs + 1) {
+        throw cff.malformed();
+    }
+    std::vector<size_t> sizes(n_glyphs);
+    for (size_t g = 0; g < n_glyphs; g++) {
+        sizes[g] = offsets[g + 1] - offsets[g];
+    }
+    return sizes;
+}
+
+} // namespace
+
+std::vector<size_t> optift::read_glyph_outline_sizes(hb_face_t *face) {
+    const size_t n_glyphs = hb_face_get_glyph_count(face);
+    if (const Table glyf{face, HB_TAG('g', 'l', 'y', 'f'), "glyf"};
+        glyf.reader.size() > 0) {
+        const Table loca{face, HB_TAG('l', 'o', 'c', 'a'), "loca"};
+        const Table head{face, HB_TAG('h', 'e', 'a', 'd'), "head"};
+        // indexToLocFormat
+        constexpr size_t INDEX_TO_LOC_FORMAT_OFFSET = 50;
+        const bool long_offsets =
+            head.reader.u16(INDEX_TO_LOC_FORMAT_OFFSET) != 0;
+        return read_glyf_sizes(glyf.reader, loca.reader, long_offsets,
+                               n_glyphs);
+    }
+    if (const Table cff{face, HB_TAG('C', 'F', 'F', ' '), "CFF"};
+        cff.reader.size() > 0) {
+        return read_cff_sizes(cff.reader, n_glyphs);
+    }
+    throw std::runtime_error("the font has neither glyf nor CFF outlines");
+}
+
+std::vector<size_t>
+optift::read_codepoint_outline_sizes(hb_face_t *face,
+                                     std::span<const UChar32> codepoints) {
+    const std::vector<size_t> glyph_sizes = read_glyph_outline_sizes(face);
+    const FontPtr font{hb_font_create(face)};
+    std::vector<size_t> sizes(codepoints.size(), 0);
+    for (size_t i = 0; i < codepoints.size(); i++) {
+        hb_codepoint_t glyph = 0;
+        if (hb_font_get_nominal_glyph(
+                font.get(), static_cast<hb_codepoint_t>(codepoints[i]),
+                &glyph) &&
+            glyph < glyph_sizes.size()) {
+            sizes[i] = glyph_sizes[glyph];
+        }
+    }
+    return sizes;
+}
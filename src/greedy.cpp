@@ -0,0 +1,174 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+
+#include <range/v3/algorithm/sort.hpp>
+#include <range/v3/range/conversion.hpp>
+#include <range/v3/view/iota.hpp>
+
+using namespace optift;
+
+// Partition boundaries are picked among this many candidate cuts of the
+// ranked items, spaced evenly by size
+constexpr size_t GREEDY_CANDIDATE_CUTS = 128;
+// Items whose weighted document frequencies are within this factor of each
+// other fall into the same frequency band, and are ranked by co-occurrence
+// within it
+constexpr double GREEDY_BAND_RATIO = 1.5;
+
+namespace {
+
+/**
+ * Ranks items from the most to the least frequent. Items are grouped into
+ * bands of similar weighted document frequency, and within a band, items
+ * whose heaviest request is the same are kept next to each other, so that
+ * cutting the ranking into partitions splits few requests.
+ */
+std::vector<size_t> rank_items(const PartitionInstance &instance) {
+    const size_t n = instance.n_items;
+    std::vector<double> item_weights(n, 0.0);
+    // The heaviest request of each item, ties going to the first one
+    std::vector<size_t> heaviest(n, std::numeric_limits<size_t>::max());
+    for (size_t x = 0; x < n; x++) {
+        for (const size_t u : instance.item_requests.row(x)) {
+            item_weights[x] += instance.weights[u];
+            if (heaviest[x] == std::numeric_limits<size_t>::max() ||
+                instance.weights[u] > instance.weights[heaviest[x]]) {
+                heaviest[x] = u;
+            }
+        }
+    }
+    const double max_weight =
+        n == 0 ? 0.0 : *std::max_element(item_weights.begin(),
+                                         item_weights.end());
+    // Items in no request come last
+    std::vector<size_t> band(n, std::numeric_limits<size_t>::max());
+    for (size_t x = 0; x < n; x++) {
+        if (item_weights[x] > 0.0) {
+            band[x] = static_cast<size_t>(
+                std::log(max_weight / item_weights[x]) /
+                std::log(GREEDY_BAND_RATIO));
+        }
+    }
+    std::vector<size_t> order =
+        ranges::views::iota(size_t(0), n) | ranges::to<std::vector>();
+    ranges::sort(order, [&](size_t a, size_t b) {
+        return std::tuple{band[a], heaviest[a], a} <
+               std::tuple{band[b], heaviest[b], b};
+    });
+    return order;
+}
+
+} // namespace
+
+PartitionSoln
+optift::partition_solve_greedy(const PartitionInstance &instance) {
+    const size_t n = instance.n_items;
+    const std::vector<size_t> order = rank_items(instance);
+    std::vector<size_t> prefix(n + 1, 0);
+    for (size_t j = 0; j < n; j++) {
+        prefix[j + 1] = prefix[j] + instance.item_sizes[order[j]];
+    }
+
+    // Candidate cuts, as positions in order. The first is 0 and the last n.
+    std::vector<size_t> cuts{0};
+    for (size_t g = 1; g <= GREEDY_CANDIDATE_CUTS; g++) {
+        const size_t target = prefix[n] * g / GREEDY_CANDIDATE_CUTS;
+        const size_t j = static_cast<size_t>(
+            std::lower_bound(prefix.begin(), prefix.end(), target) -
+            prefix.begin());
+        if (j > cuts.back()) {
+            cuts.push_back(j);
+        }
+    }
+    if (cuts.back() != n) {
+        cuts.push_back(n);
+    }
+    const size_t n_cuts = cuts.size();
+
+    // cost[g * n_cuts + h] is the cost of a partition of the items between
+    // cuts g and h: its size times the weight of the requests using it
+    std::vector<double> cost(n_cuts * n_cuts,
+                             std::numeric_limits<double>::infinity());
+    tbb::enumerable_thread_specific<std::vector<size_t>> seen{
+        [&] { return std::vector<size_t>(instance.n_requests(), 0); }};
+    tbb::parallel_for(size_t(0), n_cuts - 1, [&](size_t g) {
+        auto &stamp = seen.local();
+        double weight = 0.0;
+        size_t h = g + 1;
+        for (size_t j = cuts[g]; j < n; j++) {
+            for (const size_t u : instance.item_requests.row(order[j])) {
+                // Stamps are unique per start cut, so stamp needs no reset
+                if (stamp[u] != g + 1) {
+                    stamp[u] = g + 1;
+                    weight += instance.weights[u];
+                }
+            }
+            if (j + 1 == cuts[h]) {
+                cost[g * n_cuts + h] =
+                    weight == 0.0 ? 0.0
+                                  : instance.cost_model(prefix[j + 1] -
+                                                        prefix[cuts[g]]) *
+                                        weight;
+                h++;
+            }
+        }
+    });
+
+    // best[k][h] is the lowest cost of the items before cut h in at most
+    // k + 1 partitions, and from[k][h] the cut where the last one starts
+    const size_t n_parts = instance.n_partitions;
+    std::vector<std::vector<double>> best(
+        n_parts, std::vector<double>(n_cuts, 0.0));
+    std::vector<std::vector<size_t>> from(n_parts,
+                                          std::vector<size_t>(n_cuts, 0));
+    for (size_t h = 1; h < n_cuts; h++) {
+        best[0][h] = cost[h];
+    }
+    for (size_t k = 1; k < n_parts; k++) {
+        for (size_t h = 1; h < n_cuts; h++) {
+            best[k][h] = best[k - 1][h];
+            from[k][h] = h;
+            for (size_t g = 1; g < h; g++) {
+                const double c = best[k - 1][g] + cost[g * n_cuts + h];
+                if (c < best[k][h]) {
+                    best[k][h] = c;
+                    from[k][h] = g;
+                }
+            }
+        }
+    }
+
+    // Walk the cuts back from the last partition, skipping empty ones, and
+    // number the partitions from the most frequent items on
+    std::vector<size_t> starts;
+    for (size_t k = n_parts, end = n_cuts - 1; k-- > 0 && end > 0;) {
+        const size_t start = k == 0 ? 0 : from[k][end];
+        if (start != end) {
+            starts.push_back(start);
+        }
+        end = start;
+    }
+    ranges::sort(starts);
+    starts.push_back(n_cuts - 1);
+    PartitionSoln soln{
+        .n_partitions = n_parts,
+        .item_to_partition = std::vector<size_t>(n, 0),
+    };
+    for (size_t k = 0; k + 1 < starts.size(); k++) {
+        for (size_t j = cuts[starts[k]]; j < cuts[starts[k + 1]]; j++) {
+            soln.item_to_partition[order[j]] = k;
+        }
+    }
+    spdlog::debug("greedy: {} partitions, cost {}", starts.size() - 1,
+                  best[n_parts - 1][n_cuts - 1]);
+    return soln;
+}
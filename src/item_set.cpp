@@ -0,0 +1,252 @@
+#include "item_set.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+using namespace optift;
+
+// A set becomes a bitmap once it has more than one item per this many bits of
+// universe, i.e. once the array takes more memory than the bitmap.
+constexpr size_t ITEM_SET_DENSE_BITS_PER_ITEM = 32;
+// A bitmap becomes an array again once it has less than one item per this many
+// bits of universe
+constexpr size_t ITEM_SET_SPARSE_BITS_PER_ITEM = 64;
+// Intersections of arrays gallop through the larger one if it is at least
+// this many times larger than the smaller one
+constexpr size_t ITEM_SET_GALLOP_RATIO = 32;
+
+namespace {
+
+using Index = ItemSet::Index;
+
+/**
+ * Calls f with every element of small that is also in large. Each element of
+ * small is searched for by exponential then binary search from the position of
+ * the previous one, so this takes O(|small| log |large|) time.
+ *
+ * \return false if f returned false, in which case the search stops
+ */
+template <typename F>
+bool gallop_intersect(const std::vector<Index> &small,
+                      const std::vector<Index> &large, F &&f) {
+    auto lo = large.begin();
+    for (const Index x : small) {
+        // Everything before lo is below x. Double the step until hi is not.
+        size_t step = 1;
+        auto hi = lo;
+        while (hi != large.end() && *hi < x) {
+            lo = hi + 1;
+            const auto remaining = large.end() - lo;
+            hi = lo + std::min(static_cast<std::ptrdiff_t>(step), remaining);
+            step *= 2;
+        }
+        lo = std::lower_bound(lo, hi, x);
+        if (lo == large.end()) {
+            return true;
+        }
+        if (*lo == x && !f(x)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Calls f with every element of both a and b, by a linear merge or by
+ * galloping if their sizes are very different.
+ *
+ * \return false if f returned false, in which case the search stops
+ */
+template <typename F>
+bool array_intersect(const std::vector<Index> &a, const std::vector<Index> &b,
+                     F &&f) {
+    if (a.size() * ITEM_SET_GALLOP_RATIO < b.size()) {
+        return gallop_intersect(a, b, f);
+    }
+    if (b.size() * ITEM_SET_GALLOP_RATIO < a.size()) {
+        return gallop_intersect(b, a, f);
+    }
+    auto i = a.begin();
+    auto j = b.begin();
+    while (i != a.end() && j != b.end()) {
+        if (*i < *j) {
+            ++i;
+        } else if (*j < *i) {
+            ++j;
+        } else {
+            if (!f(*i)) {
+                return false;
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool ItemSet::test(size_t i) const {
+    if (dense) {
+        return bitmap.test(i);
+    }
+    return std::binary_search(array.begin(), array.end(),
+                              static_cast<Index>(i));
+}
+
+size_t ItemSet::intersect_into(const ItemSet &other, ItemSet &inter) const {
+    assert_same_universe(other);
+    assert_same_universe(inter);
+    if (dense && other.dense) {
+        if (inter.bitmap.n_items != n_items) {
+            inter.bitmap = DynamicBitSet{n_items};
+        }
+        inter.cardinality = bitmap.intersect_into(other.bitmap, inter.bitmap);
+        inter.dense = true;
+        return inter.cardinality;
+    }
+
+    inter.array.clear();
+    inter.dense = false;
+    if (!dense && !other.dense) {
+        array_intersect(array, other.array, [&](Index x) {
+            inter.array.push_back(x);
+            return true;
+        });
+    } else {
+        const ItemSet &sparse = dense ? other : *this;
+        const ItemSet &bits = dense ? *this : other;
+        for (const Index x : sparse.array) {
+            if (bits.bitmap.test(x)) {
+                inter.array.push_back(x);
+            }
+        }
+    }
+    inter.cardinality = inter.array.size();
+    return inter.cardinality;
+}
+
+bool ItemSet::is_disjoint(const ItemSet &other) const {
+    assert_same_universe(other);
+    if (dense && other.dense) {
+        return bitmap.is_disjoint(other.bitmap);
+    }
+    if (!dense && !other.dense) {
+        return array_intersect(array, other.array,
+                               [](Index) { return false; });
+    }
+    const ItemSet &sparse = dense ? other : *this;
+    const ItemSet &bits = dense ? *this : other;
+    return std::ranges::none_of(sparse.array,
+                                [&](Index x) { return bits.bitmap.test(x); });
+}
+
+void ItemSet::subtract(const ItemSet &other) {
+    assert_same_universe(other);
+    if (dense && other.dense) {
+        bitmap.subtract(other.bitmap);
+        cardinality = bitmap.size();
+    } else if (dense) {
+        for (const Index x : other.array) {
+            if (bitmap.test(x)) {
+                bitmap.reset(x);
+                cardinality--;
+            }
+        }
+    } else if (other.dense) {
+        std::erase_if(array, [&](Index x) { return other.bitmap.test(x); });
+        cardinality = array.size();
+    } else {
+        // Both are sorted, so this is a merge that compacts array in place
+        auto out = array.begin();
+        auto j = other.array.begin();
+        for (const Index x : array) {
+            while (j != other.array.end() && *j < x) {
+                ++j;
+            }
+            if (j == other.array.end() || *j != x) {
+                *out++ = x;
+            }
+        }
+        array.erase(out, array.end());
+        cardinality = array.size();
+    }
+    normalize();
+}
+
+void ItemSet::unite(const ItemSet &other) {
+    assert_same_universe(other);
+    if (!dense && other.dense) {
+        to_bitmap();
+    }
+    if (dense && other.dense) {
+        bitmap.unite(other.bitmap);
+        cardinality = bitmap.size();
+    } else if (dense) {
+        for (const Index x : other.array) {
+            if (!bitmap.test(x)) {
+                bitmap.set(x);
+                cardinality++;
+            }
+        }
+    } else {
+        // Merge from the back, so that array can be extended in place
+        const size_t n = array.size();
+        array.resize(n + other.array.size());
+        auto i = array.begin() + static_cast<std::ptrdiff_t>(n);
+        auto j = other.array.end();
+        auto out = array.end();
+        while (j != other.array.begin()) {
+            if (i != array.begin() && *(i - 1) > *(j - 1)) {
+                *--out = *--i;
+            } else {
+                if (i != array.begin() && *(i - 1) == *(j - 1)) {
+                    --i;
+                }
+                *--out = *--j;
+            }
+        }
+        // Items in both sets leave a gap between the two merged parts
+        array.erase(i, out);
+        cardinality = array.size();
+    }
+    normalize();
+}
+
+void ItemSet::assert_same_universe(const ItemSet &other) const {
+    if (n_items != other.n_items) {
+        throw std::runtime_error{
+            fmt::format("item sets have different universes: {} and {}",
+                        n_items, other.n_items)};
+    }
+}
+
+void ItemSet::to_bitmap() {
+    if (bitmap.n_items != n_items) {
+        bitmap = DynamicBitSet{n_items};
+    } else {
+        bitmap.clear();
+    }
+    for (const Index x : array) {
+        bitmap.set(x);
+    }
+    dense = true;
+}
+
+void ItemSet::to_array() {
+    array.clear();
+    bitmap.for_each([&](size_t x) { array.push_back(static_cast<Index>(x)); });
+    dense = false;
+}
+
+void ItemSet::normalize() {
+    if (!dense && cardinality * ITEM_SET_DENSE_BITS_PER_ITEM > n_items) {
+        to_bitmap();
+    } else if (dense &&
+               cardinality * ITEM_SET_SPARSE_BITS_PER_ITEM < n_items) {
+        to_array();
+    }
+}
@@ -1,12 +1,21 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
 #include <cstddef>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <limits>
 #include <mutex>
+#include <numeric>
 #include <optional>
 #include <random>
+#include <regex>
 #include <span>
 #include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -27,18 +36,23 @@
 #include <woff2/encode.h>
 #include <zlib-ng.h>
 
+#include <range/v3/algorithm/equal.hpp>
 #include <range/v3/algorithm/is_sorted.hpp>
 #include <range/v3/algorithm/sort.hpp>
 #include <range/v3/numeric/accumulate.hpp>
 #include <range/v3/range/conversion.hpp>
 #include <range/v3/view/chunk.hpp>
 #include <range/v3/view/filter.hpp>
+#include <range/v3/view/iota.hpp>
 #include <range/v3/view/join.hpp>
 #include <range/v3/view/map.hpp>
 #include <range/v3/view/set_algorithm.hpp>
 #include <range/v3/view/transform.hpp>
 
+#include "access_log.h"
+#include "cost_cache.h"
 #include "cost_model.h"
+#include "glyph_outlines.h"
 #include "hb_wrap.h"
 #include "input.h"
 #include "partitioner.h"
@@ -47,23 +61,91 @@ using namespace optift;
 
 constexpr int RNG_SEED = 42;
 constexpr int NUM_SAMPLES = 100;
+// Subset sizes of the cost model samples are drawn from this many strata,
+// spaced geometrically between one glyph and the whole universe, plus a focus
+// stratum around the mean partition size, which gets this many samples per
+// round
+constexpr size_t COST_MODEL_STRATA = 8;
+constexpr size_t COST_MODEL_FOCUS_SAMPLES = 4;
+// Sampling stops once the standard error of the mean cost of every stratum
+// that partitions land in is below this fraction of it, see cost_model_error
+constexpr double COST_MODEL_TOLERANCE = 0.02;
+constexpr int BATCH_SIZE = 4096;
+constexpr double CHECKPOINT_INTERVAL = 60.0;
+constexpr double SESSION_TIMEOUT = 30.0;
+// Reduced instances with at most this many items are solved exactly
+constexpr size_t EXACT_MAX_ITEMS = 16;
+// Number of real subsets the outline cost model is calibrated on
+constexpr int OUTLINE_CALIBRATION_SAMPLES = 8;
+// Bytes that every glyph of a subset takes besides its outline, in loca, hmtx
+// and cmap
+constexpr double OUTLINE_GLYPH_OVERHEAD = 8.0;
+// Outline sizes are quantized so that the mean glyph is this many units, which
+// keeps the cost tables of the solvers small
+constexpr double OUTLINE_UNITS_PER_GLYPH = 8.0;
+
+// Set on SIGINT or SIGTERM while solving and never cleared. The solvers then
+// stop, and the best solution found so far is saved and subsetted as usual,
+// and the remaining fonts are saved with the solutions the solvers start from.
+std::atomic<bool> interrupted{false};
+
+extern "C" void handle_interrupt(int signal) {
+    interrupted = true;
+    // The handler is only installed until the first signal, so a second one
+    // terminates the program as usual
+    std::signal(signal, SIG_DFL);
+}
 
 /**
  * Builds a cost model for the given font face and codepoint universe, with
  * specified RNGs and number of samples. On a high-level, it samples subsets of
  * the universe and look at the size of the subsetted font files.
  *
+ * Samples are drawn in rounds, one per size stratum and a few more around
+ * the mean partition size, until the model is stable within
+ * COST_MODEL_TOLERANCE, see \ref cost_model_error, or n_samples are taken.
+ *
  * This can be compute-intensive since many subsetting and compression are
- * performed, so it is parallelized with TBB and cached.
+ * performed, so it is parallelized with TBB, and the samples are kept in a
+ * \ref CostModelCache, which later runs continue from.
  *
  * \param face The font face to build the cost model for
  * \param codepoints A span of codepoints to build the cost model for
  * \param rng_seed The seed for the RNG
- * \param n_samples The number of samples to take
+ * \param n_samples The maximum number of samples to take
+ * \param n_partitions_range The range of numbers of partitions to solve for,
+ *   which the sizes where partitions land are derived from
+ * \param cache_dir The directory of the cost model cache
  * \return The built cost model
  */
 CostModel build_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
-                           unsigned long rng_seed, int n_samples);
+                           unsigned long rng_seed, int n_samples,
+                           std::pair<int, int> n_partitions_range,
+                           const std::filesystem::path &cache_dir);
+
+/**
+ * Returns the path to the system's temporary directory.
+ *
+ * \return The path to the system's temporary directory
+ */
+std::filesystem::path get_temp_dir();
+
+/**
+ * Builds a cost model from the outline sizes of the glyphs of a font face
+ * instead of sampling it as a function of the number of glyphs: the size of a
+ * subset is its total outline size times a compression ratio plus a fixed
+ * overhead, both fitted to a few real subsets.
+ *
+ * \param face The font face to build the cost model for
+ * \param codepoints A span of codepoints to build the cost model for
+ * \param rng_seed The seed for the RNG that draws the calibration subsets
+ * \return A pair of the linear cost model in quantized outline units and the
+ *   size of each codepoint in these units, to use as item sizes
+ * \throw std::runtime_error If the outlines of the face cannot be read
+ */
+std::pair<FontLinearCostModel, std::vector<size_t>>
+build_outline_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
+                         unsigned long rng_seed);
 
 /**
  * Creates an abstract partition instance from the input data for a given font
@@ -73,13 +155,101 @@ CostModel build_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
  * \param font_path The font path to create the partition instance for
  * \param cost_model The cost model to use
  * \param n_partitions The number of partitions to create
+ * \param sessions Sessions from \ref read_access_log_sessions. If not empty,
+ *   every session is a request for the glyphs of all of its posts, since the
+ *   browser caches the partitions downloaded for earlier pages, weighted by
+ *   how often it occurs. The weights of the posts are then ignored.
  * \return A pair of the partition instance and a vector mapping item index to
  *   codepoint. This is used to re-map an abstract solution back to codepoint
  *   partitions.
  */
 std::pair<PartitionInstance, std::vector<UChar32>>
 create_partition_instance(const Input &input, const std::string &font_path,
-                          CostModel cost_model, size_t n_partitions);
+                          CostModel cost_model, size_t n_partitions,
+                          std::span<const Session> sessions);
+
+/**
+ * Solves a partition instance with the solvers selected on the command line.
+ * The instance is coarsened first, solved, and the solution is mapped back.
+ *
+ * \param instance The partition instance from \ref create_partition_instance.
+ *   If more than one number of partitions is to be tried, n_partitions is
+ *   updated to the chosen number.
+ * \param max_partitions The largest number of partitions to try
+ * \param program The parsed command line arguments
+ * \param control Limits and checkpoint hook of the solve. Checkpoints are
+ *   solutions of instance, not of the coarsened instance.
+ * \param initial_soln A solution to resume from, if any. Its number of
+ *   partitions is used instead of max_partitions.
+ * \return The solution
+ */
+PartitionSoln solve_partition_instance(
+    PartitionInstance &instance, size_t max_partitions,
+    const argparse::ArgumentParser &program, const SolveControl &control,
+    std::optional<PartitionSoln> initial_soln);
+
+/**
+ * Reads the solution of a font from a checkpoint file written by
+ * \ref write_checkpoint. Codepoints missing from the checkpoint go to the
+ * first partition.
+ *
+ * \param path The checkpoint file
+ * \param font_path The font path of the font
+ * \param item_to_codepoint The mapping from item index to codepoint
+ * \return The solution, or std::nullopt if there is none for the font
+ */
+std::optional<PartitionSoln>
+read_checkpoint(const std::filesystem::path &path, const std::string &font_path,
+                std::span<const UChar32> item_to_codepoint);
+
+/**
+ * Writes the solution of a font to a checkpoint file as lists of codepoints,
+ * keeping the solutions of other fonts in the file. The file is replaced
+ * atomically, so an interrupted write leaves the previous checkpoint intact.
+ *
+ * \param path The checkpoint file
+ * \param font_path The font path of the font
+ * \param soln The partition solution
+ * \param item_to_codepoint The mapping from item index to codepoint
+ */
+void write_checkpoint(const std::filesystem::path &path,
+                      const std::string &font_path, const PartitionSoln &soln,
+                      std::span<const UChar32> item_to_codepoint);
+
+/// A partition of a font in a previous build, see \ref read_previous_build.
+struct PreviousPartition {
+    std::string filename;
+    // Sorted codepoints of the partition
+    std::vector<UChar32> codepoints;
+    // The subsetted font, read up front since the output directory may be
+    // the previous build's and is cleared before writing
+    std::vector<uint8_t> data;
+};
+
+/**
+ * Reads the partitions of every font of a previous build from its manifest,
+ * written by \ref write_manifest, along with their files.
+ *
+ * \param path The output directory of the build, or its manifest
+ * \return The partitions of each font path, in the order of the manifest
+ */
+std::unordered_map<std::string, std::vector<PreviousPartition>>
+read_previous_build(const std::filesystem::path &path);
+
+/**
+ * Sets the change cost of an instance from the partitions of a previous build,
+ * see \ref ChangeCost, and gives the instance one more partition than the
+ * previous build for codepoints that are new since.
+ *
+ * \param instance The instance, whose items must be single codepoints
+ * \param item_to_codepoint The sorted codepoints of the items
+ * \param previous The partitions of the font in the previous build
+ * \param penalty See ChangeCost::from_previous
+ */
+void set_change_cost(PartitionInstance &instance,
+                     std::span<const UChar32> item_to_codepoint,
+                     std::span<const PreviousPartition> previous,
+                     double penalty);
 
 /**
  * Represents a partitioning of a single font that can be wrtten to disk and
@@ -91,11 +261,18 @@ struct FontPartitionSoln {
     std::vector<std::pair<std::string, std::vector<uint8_t>>> subsetted_fonts;
     std::unordered_map<UChar32, size_t> codepoint_to_partition;
 
+    /**
+     * Subsets the partitions of a solution. Partition k of the solution that
+     * holds the codepoints of previous[k] still in use reuses its file, and
+     * the files of other partitions are named after their content, so that
+     * cached files stay valid across builds.
+     */
     static FontPartitionSoln
     from_partition_soln(const Input &input, const std::string &font_path,
                         hb_face_t *face, const PartitionInstance &instance,
                         const PartitionSoln &soln,
-                        std::span<const UChar32> item_to_codepoint);
+                        std::span<const UChar32> item_to_codepoint,
+                        std::span<const PreviousPartition> previous = {});
 
     static FontPartitionSoln from_google_fonts(const Input &input,
                                                const std::string &font_path,
@@ -103,6 +280,20 @@ struct FontPartitionSoln {
                                                bool subset = false);
 };
 
+/**
+ * Writes the partitions of a font to the manifest of the output directory, as
+ * lists of codepoints with their files, keeping the entries of other fonts.
+ *
+ * \param output_path The output directory
+ * \param font_path The font path of the font
+ * \param soln The subsetted partitions
+ * \param item_to_codepoint The sorted codepoints of the font
+ */
+void write_manifest(const std::filesystem::path &output_path,
+                    const std::string &font_path,
+                    const FontPartitionSoln &soln,
+                    std::span<const UChar32> item_to_codepoint);
+
 /**
  * Saves the solution to a CSS file and evaluates the solution.
  *
@@ -113,13 +304,146 @@ struct FontPartitionSoln {
  * \param soln The partition solution
  * \param item_to_codepoint The mapping from item index to codepoint, also
  *   from \ref create_partition_instance
+ * \param previous The partitions of the font in a previous build, if any,
+ *   whose files are reused where unchanged
  */
 void save_and_evaluate_solution(const Input &input,
                                 const std::string &font_path, hb_face_t *face,
                                 const PartitionInstance &instance,
                                 const PartitionSoln &soln,
                                 std::span<const UChar32> item_to_codepoint,
-                                const argparse::ArgumentParser &program);
+                                const argparse::ArgumentParser &program,
+                                std::span<const PreviousPartition> previous);
+
+/**
+ * Sets the CSS cost of an instance, see \ref CssCost. The bytes per run are
+ * estimated by generating the CSS of a random assignment of the codepoints to
+ * partitions, whose runs are mostly single codepoints, and comparing its
+ * gzipped size to that of contiguous partitions with one run each.
+ *
+ * \param instance The instance, whose items must be single codepoints
+ * \param input The input data
+ * \param font_path The font path of the instance
+ * \param item_to_codepoint The sorted codepoints of the items
+ * \param css_weight Multiplies the estimated bytes per run
+ * \param rng_seed The seed of the random assignment
+ */
+void set_css_cost(PartitionInstance &instance, const Input &input,
+                  const std::string &font_path,
+                  std::span<const UChar32> item_to_codepoint, double css_weight,
+                  unsigned long rng_seed);
+
+/**
+ * Parses a range of number of partitions given as "A:B".
+ *
+ * \param range The range string
+ * \return The pair (A, B)
+ */
+std::pair<int, int> parse_n_partitions_range(const std::string &range) {
+    const auto sep = range.find(':');
+    if (sep == std::string::npos) {
+        throw std::invalid_argument(
+            fmt::format("invalid range of partitions: {}", range));
+    }
+    const int lo = std::stoi(range.substr(0, sep));
+    const int hi = std::stoi(range.substr(sep + 1));
+    if (lo < 1 || hi < lo) {
+        throw std::invalid_argument(
+            fmt::format("invalid range of partitions: {}", range));
+    }
+    return {lo, hi};
+}
+
+/**
+ * Returns the objective selected with --objective, --cap-bytes and
+ * --cap-penalty, which have been validated.
+ *
+ * \param program The parsed command line arguments
+ */
+Objective parse_objective(const argparse::ArgumentParser &program) {
+    const auto name = program.get<std::string>("--objective");
+    Objective objective;
+    if (name == "p95") {
+        objective.kind = Objective::Kind::Tail;
+        objective.tail_fraction = 0.05; // NOLINT(*-magic-numbers)
+    } else if (name == "capped") {
+        objective.kind = Objective::Kind::Capped;
+        objective.cap = program.get<double>("--cap-bytes");
+        objective.penalty = program.get<double>("--cap-penalty");
+    }
+    return objective;
+}
+
+/**
+ * Returns the network selected with --network, with the round-trip time and
+ * bandwidth overridden by --rtt-ms and --bandwidth-kbps if given.
+ *
+ * \param program The parsed command line arguments
+ */
+NetworkProfile parse_network_profile(const argparse::ArgumentParser &program) {
+    constexpr double KBPS = 1000.0 / 8.0;
+    constexpr double MS = 1e-3;
+    NetworkProfile profile =
+        NetworkProfile::from_name(program.get<std::string>("--network"));
+    if (const auto rtt = program.present<double>("--rtt-ms")) {
+        profile.rtt_seconds = *rtt * MS;
+    }
+    if (const auto bandwidth = program.present<double>("--bandwidth-kbps")) {
+        profile.bytes_per_second = *bandwidth * KBPS;
+    }
+    return profile;
+}
+
+/**
+ * Sets the partition size bounds of an instance from --min-partition-bytes
+ * and --max-partition-bytes, as the partition sizes, in glyphs or outline
+ * units, whose predicted size is within them.
+ *
+ * \param instance The instance, whose items must not be merged yet
+ * \param bytes_model The cost model of the instance, without the latency of
+ *   requests
+ * \param program The parsed command line arguments
+ */
+void set_partition_size_bounds(PartitionInstance &instance,
+                               const CostModel &bytes_model,
+                               const argparse::ArgumentParser &program) {
+    const auto min_bytes = program.present<double>("--min-partition-bytes");
+    const auto max_bytes = program.present<double>("--max-partition-bytes");
+    if (!min_bytes && !max_bytes) {
+        return;
+    }
+    const size_t total_size =
+        ranges::accumulate(instance.item_sizes, size_t(0));
+    if (max_bytes) {
+        // The largest partition size up to which every size fits
+        size_t n = 0;
+        while (n < total_size && bytes_model(n + 1) <= *max_bytes) {
+            n++;
+        }
+        if (const size_t largest = std::ranges::max(instance.item_sizes);
+            n < largest) {
+            throw std::runtime_error(fmt::format(
+                "--max-partition-bytes {} is below the predicted size of a "
+                "single glyph, {:.0f} bytes",
+                *max_bytes, bytes_model(largest)));
+        }
+        instance.max_partition_size = n;
+    }
+    if (min_bytes) {
+        size_t n = 1;
+        while (n < total_size && bytes_model(n) < *min_bytes) {
+            n++;
+        }
+        instance.min_partition_size = n;
+    }
+    if (instance.min_partition_size > instance.max_partition_size) {
+        throw std::runtime_error(
+            "--min-partition-bytes is above --max-partition-bytes");
+    }
+    spdlog::info("partitions must have a size of {} to {}",
+                 instance.min_partition_size,
+                 std::min(instance.max_partition_size, total_size));
+}
 
 int main(int argc, char **argv) {
     argparse::ArgumentParser program{"optift"};
@@ -131,16 +455,145 @@ int main(int argc, char **argv) {
         .required();
     program.add_argument("-n", "--n-partitions")
         .help("number of partitions to create")
-        .required()
         .scan<'i', int>();
+    program.add_argument("--n-partitions-range")
+        .help("solve for every number of partitions in A:B and pick one "
+              "automatically, instead of -n");
+    program.add_argument("--n-partitions-tolerance")
+        .help("with --n-partitions-range, pick the smallest number of "
+              "partitions within this relative tolerance of the best cost "
+              "instead of the knee of the cost curve")
+        .scan<'g', double>();
     program.add_argument("--rng")
         .help("RNG seed for sampling cost model")
         .default_value(RNG_SEED)
         .scan<'i', int>();
+    program.add_argument("--cost-model")
+        .help("cost model of a partition file: sampled (from its number of "
+              "glyphs) or outline (from the outline sizes of its glyphs, "
+              "calibrated on a few subsets)")
+        .default_value(std::string{"sampled"});
     program.add_argument("--samples")
-        .help("number of samples for cost model")
+        .help("maximum number of samples for the sampled cost model")
         .default_value(NUM_SAMPLES)
         .scan<'i', int>();
+    program.add_argument("--cache-dir")
+        .help("directory to keep the cost model samples in, which later runs "
+              "reuse or continue from (default: optift in the temporary "
+              "directory)");
+    program.add_argument("--solver")
+        .help("solver to use with -n: heuristic, multilevel for very large "
+              "codepoint sets, or minibatch for very many pages")
+        .default_value(std::string{"heuristic"});
+    program.add_argument("--initial-solution")
+        .help("starting point of the heuristic and minibatch solvers and of "
+              "the coarsest level of the multilevel solver: greedy "
+              "(frequency tiers) or baseline (everything in one partition)")
+        .default_value(std::string{"greedy"});
+    program.add_argument("--network")
+        .help("network to minimize load times on rather than bytes: none, "
+              "3g, 4g or cable; each font request then also costs the bytes "
+              "that could be downloaded in one round trip")
+        .default_value(std::string{"none"});
+    program.add_argument("--rtt-ms")
+        .help("round-trip time of --network in milliseconds")
+        .scan<'g', double>();
+    program.add_argument("--bandwidth-kbps")
+        .help("bandwidth of --network in kbit/s")
+        .scan<'g', double>();
+    program.add_argument("--min-partition-bytes")
+        .help("predicted size below which a partition file is merged into "
+              "another")
+        .scan<'g', double>();
+    program.add_argument("--max-partition-bytes")
+        .help("predicted size above which a partition file is split")
+        .scan<'g', double>();
+    program.add_argument("--css-weight")
+        .help("weight of the estimated gzipped size of the unicode-range "
+              "lists in font.css, which every page loads, relative to font "
+              "bytes (0 to ignore the CSS)")
+        .default_value(1.0)
+        .scan<'g', double>();
+    program.add_argument("--previous")
+        .help("output directory or manifest.json of a previous build to "
+              "start from; its partitions are kept unless changing them pays "
+              "for what returning visitors download again, and unchanged "
+              "files are reused as is");
+    program.add_argument("--change-penalty")
+        .help("with --previous, cost of changing a partition relative to its "
+              "bytes times the fraction of pages that load it")
+        .default_value(1.0)
+        .scan<'g', double>();
+    program.add_argument("--max-changed-bytes")
+        .help("with --previous, maximum total size of the previous partition "
+              "files that may change")
+        .scan<'g', double>();
+    program.add_argument("--access-log")
+        .help("nginx or Apache access log in the combined format; if given, "
+              "the expected bytes per browsing session are minimized, with "
+              "the browser cache, instead of using the weights of the posts");
+    program.add_argument("--post-url-pattern")
+        .help("regex matched against request paths in --access-log; its "
+              "first capture group, or the whole match, is the post key")
+        .default_value(std::string{"^[^?#]*"});
+    program.add_argument("--session-timeout")
+        .help("minutes of inactivity after which a visitor in --access-log "
+              "starts a new session")
+        .default_value(SESSION_TIMEOUT)
+        .scan<'g', double>();
+    program.add_argument("--objective")
+        .help("cost over pages to minimize: mean, p95 (mean of the costliest "
+              "5% of page views) or capped (mean plus --cap-penalty times the "
+              "bytes of each page above --cap-bytes)")
+        .default_value(std::string{"mean"});
+    program.add_argument("--cap-bytes")
+        .help("bytes per page above which the capped objective is penalized")
+        .scan<'g', double>();
+    program.add_argument("--cap-penalty")
+        .help("penalty per byte above --cap-bytes of the capped objective")
+        .default_value(1.0)
+        .scan<'g', double>();
+    program.add_argument("--batch-size")
+        .help("number of pages drawn per round of the minibatch solver")
+        .default_value(BATCH_SIZE)
+        .scan<'i', int>();
+    program.add_argument("--solve-time")
+        .help("seconds of simulated annealing after the heuristic (0 to "
+              "disable)")
+        .default_value(0.0)
+        .scan<'g', double>();
+    program.add_argument("--solve-chains")
+        .help("number of concurrent annealing chains (0 for one per thread)")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--time-limit")
+        .help("seconds to spend solving each font (0 for no limit); the best "
+              "solution found so far is used when time runs out")
+        .default_value(0.0)
+        .scan<'g', double>();
+    program.add_argument("--max-iterations")
+        .help("maximum number of iterations of the heuristic (0 for no "
+              "limit)")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--gap-tolerance")
+        .help("stop solving once the cost is within this fraction of the "
+              "lower bound, e.g. 0.05")
+        .scan<'g', double>();
+    program.add_argument("--checkpoint")
+        .help("file to periodically save the current solution to, outside "
+              "of the output directory");
+    program.add_argument("--checkpoint-interval")
+        .help("seconds between two checkpoints")
+        .default_value(CHECKPOINT_INTERVAL)
+        .scan<'g', double>();
+    program.add_argument("--resume")
+        .help("resume from the solutions saved in the --checkpoint file")
+        .flag();
+    program.add_argument("--report")
+        .help("write the cost and its distribution over pages to "
+              "report.json in the output directory")
+        .flag();
     program.add_argument("--compare-baseline")
         .help("compare heuristic solution to baseline solution")
         .flag();
@@ -148,8 +601,92 @@ int main(int argc, char **argv) {
         .help("compare heuristic solution to Google Fonts solution")
         .flag();
 
+    // Range of number of partitions to solve for
+    std::pair<int, int> n_partitions_range;
     try {
         program.parse_args(argc, argv);
+        if (const auto range =
+                program.present<std::string>("--n-partitions-range")) {
+            n_partitions_range = parse_n_partitions_range(*range);
+        } else if (const auto n = program.present<int>("--n-partitions")) {
+            n_partitions_range = {*n, *n};
+        } else {
+            throw std::runtime_error(
+                "one of --n-partitions and --n-partitions-range is required");
+        }
+        if (const auto solver = program.get<std::string>("--solver");
+            solver != "heuristic" && solver != "multilevel" &&
+            solver != "minibatch") {
+            throw std::runtime_error(fmt::format("unknown solver: {}", solver));
+        }
+        if (const auto model = program.get<std::string>("--cost-model");
+            model != "sampled" && model != "outline") {
+            throw std::runtime_error(
+                fmt::format("unknown cost model: {}", model));
+        }
+        if (const auto initial = program.get<std::string>("--initial-solution");
+            initial != "greedy" && initial != "baseline") {
+            throw std::runtime_error(
+                fmt::format("unknown initial solution: {}", initial));
+        }
+        if (const auto objective = program.get<std::string>("--objective");
+            objective != "mean" && objective != "p95" &&
+            objective != "capped") {
+            throw std::runtime_error(
+                fmt::format("unknown objective: {}", objective));
+        }
+        if (program.get<std::string>("--objective") == "capped" &&
+            !program.present<double>("--cap-bytes")) {
+            throw std::runtime_error("--objective capped requires --cap-bytes");
+        }
+        if (program.get<double>("--cap-penalty") < 0.0) {
+            throw std::runtime_error("--cap-penalty must be non-negative");
+        }
+        for (const auto *name :
+             {"--min-partition-bytes", "--max-partition-bytes"}) {
+            if (const auto bytes = program.present<double>(name);
+                bytes && *bytes <= 0.0) {
+                throw std::runtime_error(
+                    fmt::format("{} must be positive", name));
+            }
+        }
+        if (const NetworkProfile profile = parse_network_profile(program);
+            profile.rtt_seconds < 0.0 || profile.bytes_per_second < 0.0) {
+            throw std::runtime_error(
+                "--rtt-ms and --bandwidth-kbps must be non-negative");
+        }
+        // Throws std::regex_error if the pattern is invalid
+        std::regex{program.get<std::string>("--post-url-pattern")};
+        if (program.get<double>("--css-weight") < 0.0) {
+            throw std::runtime_error("--css-weight must be non-negative");
+        }
+        if (program.get<double>("--change-penalty") < 0.0) {
+            throw std::runtime_error("--change-penalty must be non-negative");
+        }
+        if (const auto bytes = program.present<double>("--max-changed-bytes");
+            bytes && *bytes < 0.0) {
+            throw std::runtime_error(
+                "--max-changed-bytes must be non-negative");
+        }
+        if (program.present("--max-changed-bytes") &&
+            (!program.present("--previous") ||
+             program.get<double>("--change-penalty") == 0.0)) {
+            throw std::runtime_error("--max-changed-bytes requires --previous "
+                                     "and a positive --change-penalty");
+        }
+        if (program.get<double>("--session-timeout") <= 0.0) {
+            throw std::runtime_error("--session-timeout must be positive");
+        }
+        if (program.get<int>("--batch-size") < 1) {
+            throw std::runtime_error("--batch-size must be positive");
+        }
+        if (const auto tolerance = program.present<double>("--gap-tolerance");
+            tolerance && (*tolerance < 0.0 || *tolerance >= 1.0)) {
+            throw std::runtime_error("--gap-tolerance must be in [0, 1)");
+        }
+        if (program.get<bool>("--resume") && !program.present("--checkpoint")) {
+            throw std::runtime_error("--resume requires --checkpoint");
+        }
     } catch (const std::exception &err) {
         std::cerr << err.what() << std::endl;
         std::cerr << program;
@@ -157,8 +694,16 @@ int main(int argc, char **argv) {
     }
 
     const int rnd_seed = program.get<int>("--rng");
+    const NetworkProfile network = parse_network_profile(program);
     const int n_samples = program.get<int>("--samples");
-    const int n_partitions = program.get<int>("--n-partitions");
+    const std::filesystem::path cache_dir =
+        program.present("--cache-dir").value_or(get_temp_dir() / "optift");
+    const auto [min_partitions, max_partitions] = n_partitions_range;
+
+    std::unordered_map<std::string, std::vector<PreviousPartition>> previous;
+    if (const auto previous_path = program.present("--previous")) {
+        previous = read_previous_build(*previous_path);
+    }
 
     const std::filesystem::path output_path{
         program.get<std::string>("--output")};
@@ -171,6 +716,28 @@ int main(int argc, char **argv) {
     const json j = json::parse(f);
     const Input input = j.get<Input>();
 
+    std::vector<Session> sessions;
+    if (const auto log_path = program.present("--access-log")) {
+        std::ifstream log{*log_path};
+        if (!log) {
+            throw std::runtime_error(
+                fmt::format("could not open access log {}", *log_path));
+        }
+        const AccessLogOptions log_options{
+            .post_pattern =
+                std::regex{program.get<std::string>("--post-url-pattern")},
+            .session_timeout =
+                std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::duration<double, std::ratio<60>>{
+                        program.get<double>("--session-timeout")}),
+        };
+        sessions = read_access_log_sessions(log, log_options);
+        if (sessions.empty()) {
+            throw std::runtime_error(
+                "no page views in the access log match --post-url-pattern");
+        }
+    }
+
     for (const auto &font_path : input.get_unique_font_paths()) {
         const std::vector<UChar32> codepoints =
             input.get_all_codepoints_sorted(font_path);
@@ -182,19 +749,103 @@ int main(int argc, char **argv) {
         const FacePtr face{hb_face_create(blob.get(), 0)};
 
         spdlog::info("fitting cost model...");
-        const auto cost_model =
-            build_cost_model(face.get(), codepoints, rnd_seed, n_samples);
-        const auto [instance, item_to_codepoint] = create_partition_instance(
-            input, font_path, cost_model, n_partitions);
+        const double request_cost = network.request_cost();
+        if (request_cost > 0.0) {
+            spdlog::info("each font request costs {:.0f} bytes of latency",
+                         request_cost);
+        }
+        CostModel bytes_model;
+        CostModel cost_model;
+        // Outline units of each item, or empty if items are single glyphs
+        std::vector<size_t> item_sizes;
+        if (program.get<std::string>("--cost-model") == "outline") {
+            auto [linear, sizes] =
+                build_outline_cost_model(face.get(), codepoints, rnd_seed);
+            bytes_model = linear;
+            // Still linear, which the solvers evaluate in closed form
+            linear.cost_base += request_cost;
+            cost_model = linear;
+            item_sizes = std::move(sizes);
+        } else {
+            bytes_model =
+                build_cost_model(face.get(), codepoints, rnd_seed, n_samples,
+                                 n_partitions_range, cache_dir);
+            cost_model = request_cost > 0.0
+                             ? FontLatencyCostModel{bytes_model, request_cost}
+                             : bytes_model;
+        }
+        auto [instance, item_to_codepoint] = create_partition_instance(
+            input, font_path, cost_model, min_partitions, sessions);
+        if (!item_sizes.empty()) {
+            instance.item_sizes = std::move(item_sizes);
+        }
+        set_partition_size_bounds(instance, bytes_model, program);
+        set_css_cost(instance, input, font_path, item_to_codepoint,
+                     program.get<double>("--css-weight"), rnd_seed);
+        instance.objective = parse_objective(program);
+        std::span<const PreviousPartition> previous_partitions;
+        if (const auto it = previous.find(font_path); it != previous.end()) {
+            previous_partitions = it->second;
+            set_change_cost(instance, item_to_codepoint, previous_partitions,
+                            program.get<double>("--change-penalty"));
+        } else if (program.present("--previous")) {
+            spdlog::warn("{} is not in the previous build", font_path);
+        }
 
-        const PartitionSoln soln_baseline = partition_solve_baseline(instance);
-        spdlog::info("baseline cost: {}", instance.eval(soln_baseline));
-        const PartitionSoln soln_heuristic =
-            partition_solve_heuristic(instance, soln_baseline);
-        spdlog::info("heuristic cost: {}", instance.eval(soln_heuristic));
+        SolveControl control;
+        control.max_iterations =
+            static_cast<size_t>(program.get<int>("--max-iterations"));
+        control.interrupt = &interrupted;
+        if (const double time_limit = program.get<double>("--time-limit");
+            time_limit > 0) {
+            control.deadline =
+                SolveControl::Clock::now() +
+                std::chrono::duration_cast<SolveControl::Clock::duration>(
+                    std::chrono::duration<double>{time_limit});
+        }
+        std::optional<PartitionSoln> initial_soln;
+        const auto checkpoint_path = program.present("--checkpoint");
+        if (checkpoint_path) {
+            control.checkpoint = [&, codepoints = std::span<const UChar32>{
+                                         item_to_codepoint}](
+                                     const PartitionSoln &soln) {
+                write_checkpoint(*checkpoint_path, font_path, soln, codepoints);
+            };
+            control.checkpoint_interval = std::chrono::duration<double>{
+                program.get<double>("--checkpoint-interval")};
+            if (program.get<bool>("--resume")) {
+                initial_soln = read_checkpoint(*checkpoint_path, font_path,
+                                               item_to_codepoint);
+            }
+        }
+        if (!initial_soln && instance.has_change_cost()) {
+            initial_soln =
+                instance.change_cost.warm_start(instance.n_partitions);
+        }
+
+        const bool interrupted_before = interrupted;
+        if (interrupted_before) {
+            spdlog::info("interrupted, not optimizing {}", font_path);
+        } else {
+            std::signal(SIGINT, handle_interrupt);
+            std::signal(SIGTERM, handle_interrupt);
+        }
+        const PartitionSoln soln = solve_partition_instance(
+            instance, static_cast<size_t>(max_partitions), program, control,
+            std::move(initial_soln));
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        if (interrupted && !interrupted_before) {
+            spdlog::warn("interrupted, using the best solution found so far");
+        }
+        if (checkpoint_path) {
+            write_checkpoint(*checkpoint_path, font_path, soln,
+                             item_to_codepoint);
+        }
 
         save_and_evaluate_solution(input, font_path, face.get(), instance,
-                                   soln_heuristic, item_to_codepoint, program);
+                                   soln, item_to_codepoint, program,
+                                   previous_partitions);
     }
     return 0;
 }
@@ -296,11 +947,11 @@ std::vector<uint8_t> subset_font(hb_face_t *face,
     return compressed_data;
 }
 
-/**
- * Returns the path to the system's temporary directory.
- *
- * \return The path to the system's temporary directory
- */
+/// Returns a 32-bit hash of some data, to name files after their content.
+uint32_t content_hash(std::span<const uint8_t> data) {
+    return static_cast<uint32_t>(hash_bytes(data));
+}
+
 std::filesystem::path get_temp_dir() {
 #if defined(_WIN32) || defined(_WIN64)
     const char *temp_dir = std::getenv("TEMP");
@@ -327,104 +978,266 @@ CostModel build_cost_model_from_data(
     return FontEmpiricalCostModel{raw_data};
 }
 
-CostModel build_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
-                           unsigned long rng_seed, int n_samples) {
-    const std::filesystem::path cache_path = [&]() {
-        // Some quick and dirty hash function to generate a unique identifier
-        // for the parameters for this run
-        constexpr uint64_t FNV1A_HASH_BASIS = 14695981039346656037ULL;
-        constexpr uint64_t FNV1A_HASH_PRIME = 1099511628211ULL;
-
-        const BlobPtr blob{hb_face_reference_blob(face)};
-        unsigned int length = 0;
-        const char *const blob_data = hb_blob_get_data(blob.get(), &length);
-        const std::span<const char> blob_span{blob_data, length};
-
-        uint64_t fnv1a_hash = FNV1A_HASH_BASIS;
-        const auto hash = [&fnv1a_hash](const auto x) {
-            fnv1a_hash ^= x;
-            fnv1a_hash *= FNV1A_HASH_PRIME;
-        };
-        for (unsigned int i = 0; i < length; i++)
-            hash(blob_span[i]);
-        // TODO: think again if codepoints should be hashed
-        for (const auto c : codepoints)
-            hash(c);
-        hash(rng_seed);
-        hash(n_samples);
-        return get_temp_dir() / fmt::format("optift_{:016X}.json", fnv1a_hash);
-    }();
-
-    if (std::filesystem::exists(cache_path) &&
-        std::filesystem::is_regular_file(cache_path)) {
-        spdlog::info("loading cost model raw data from {}",
-                     cache_path.string());
-        json j;
-        std::ifstream f{cache_path};
-        f >> j;
-        const std::vector<std::pair<size_t, double>> raw_data =
-            j["raw_data"]
-                .template get<std::vector<std::pair<size_t, double>>>();
-        return build_cost_model_from_data(raw_data);
+/// Range of subset sizes that cost model samples are drawn from.
+struct SizeStratum {
+    size_t lo;
+    size_t hi;
+};
+
+/**
+ * Returns the strata of subset sizes of a universe of n_codepoints
+ * codepoints: COST_MODEL_STRATA geometrically spaced ones, which cover all
+ * sizes, followed by the focus stratum from half the smallest to twice the
+ * largest mean partition size.
+ */
+std::vector<SizeStratum>
+cost_model_strata(size_t n_codepoints, std::pair<int, int> n_partitions_range) {
+    std::vector<SizeStratum> strata;
+    size_t lo = 1;
+    for (size_t j = 1; j <= COST_MODEL_STRATA; j++) {
+        const size_t hi = std::max(
+            lo, static_cast<size_t>(std::lround(
+                    std::pow(static_cast<double>(n_codepoints),
+                             static_cast<double>(j) / COST_MODEL_STRATA))));
+        strata.push_back({lo, hi});
+        lo = std::min(hi + 1, n_codepoints);
     }
+    const auto [min_partitions, max_partitions] = n_partitions_range;
+    const size_t focus_lo = std::max(
+        size_t(1), n_codepoints / (2 * static_cast<size_t>(max_partitions)));
+    strata.push_back({
+        focus_lo,
+        std::clamp(2 * n_codepoints / static_cast<size_t>(min_partitions),
+                   focus_lo, std::max(focus_lo, n_codepoints)),
+    });
+    return strata;
+}
 
-    std::mt19937_64 rng{rng_seed};
-    std::uniform_int_distribution<size_t> size_dist{1, codepoints.size()};
-    std::vector<std::vector<UChar32>> samples;
-    samples.reserve(n_samples);
+/**
+ * Estimates the error of the cost model of some samples from the residuals of
+ * a linear fit to the samples within each stratum: the largest standard error
+ * of the mean fitted cost of a stratum, relative to that mean, over the strata
+ * that partitions can land in, i.e. those above half the smallest mean
+ * partition size. Samples count for every stratum that their size is in, so
+ * that samples drawn for other strata or cached ones are used too.
+ *
+ * \param raw_data The samples, as pairs of subset size and cost
+ * \param strata The strata from \ref cost_model_strata
+ * \return The relative error, or infinity if a stratum has too few samples
+ */
+double cost_model_error(std::span<const std::pair<size_t, double>> raw_data,
+                        std::span<const SizeStratum> strata) {
+    const size_t min_size = strata.back().lo;
+    double error = 0.0;
+    for (size_t j = 0; j < strata.size(); j++) {
+        if (strata[j].hi < min_size) {
+            continue;
+        }
+        std::vector<std::pair<size_t, double>> samples;
+        for (const auto &sample : raw_data) {
+            if (sample.first >= strata[j].lo && sample.first <= strata[j].hi) {
+                samples.push_back(sample);
+            }
+        }
+        // A line through two samples has no residuals
+        if (samples.size() < 3) {
+            return std::numeric_limits<double>::infinity();
+        }
+        const bool single_size =
+            std::ranges::all_of(samples, [&](const auto &sample) {
+                return sample.first == samples[0].first;
+            });
+        const auto n_samples = static_cast<double>(samples.size());
+        const double mean =
+            ranges::accumulate(samples | ranges::views::values, 0.0) /
+            n_samples;
+        double sum_squares = 0.0;
+        if (single_size) {
+            for (const auto &[_, cost] : samples) {
+                sum_squares += (cost - mean) * (cost - mean);
+            }
+            sum_squares /= n_samples - 1;
+        } else {
+            const FontLinearCostModel fit{samples};
+            for (const auto &[size, cost] : samples) {
+                sum_squares += (cost - fit(size)) * (cost - fit(size));
+            }
+            sum_squares /= n_samples - 2;
+        }
+        error = std::max(error, std::sqrt(sum_squares / n_samples) / mean);
+    }
+    return error;
+}
 
-    for (int i = 0; i < n_samples; i++) {
-        const size_t n = size_dist(rng);
-        std::vector<UChar32> sample;
-        sample.reserve(n);
-        std::sample(codepoints.begin(), codepoints.end(),
-                    std::back_inserter(sample), n, rng);
-        samples.emplace_back(std::move(sample));
+CostModel build_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
+                           unsigned long rng_seed, int n_samples,
+                           std::pair<int, int> n_partitions_range,
+                           const std::filesystem::path &cache_dir) {
+    const std::vector<SizeStratum> strata =
+        cost_model_strata(codepoints.size(), n_partitions_range);
+
+    const BlobPtr blob{hb_face_reference_blob(face)};
+    unsigned int length = 0;
+    const char *const blob_data = hb_blob_get_data(blob.get(), &length);
+    CostModelCache cache{
+        cache_dir,
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        {reinterpret_cast<const uint8_t *>(blob_data), length},
+        codepoints};
+    std::vector<std::pair<size_t, double>> raw_data = cache.samples();
+    double error = std::numeric_limits<double>::infinity();
+    if (!raw_data.empty()) {
+        error = cost_model_error(raw_data, strata);
+        spdlog::info("loaded {} cost model samples from {}", raw_data.size(),
+                     cache.path().string());
+    }
+    if (error < COST_MODEL_TOLERANCE ||
+        raw_data.size() >= static_cast<size_t>(n_samples)) {
+        return build_cost_model_from_data(raw_data);
     }
 
-    std::vector<std::pair<size_t, double>> raw_data;
+    // Seeded with the number of cached samples too, so that a resumed run
+    // draws new subsets instead of repeating those of the run it resumes,
+    // whose duplicates would overstate the confidence of cost_model_error
+    std::seed_seq seed{static_cast<uint64_t>(rng_seed),
+                       static_cast<uint64_t>(raw_data.size())};
+    std::mt19937_64 rng{seed};
     raw_data.reserve(n_samples);
-    std::mutex results_mutex;
 
     using namespace indicators;
     BlockProgressBar bar{
         option::Start{"|"},
         option::End{"|"},
-        option::MaxProgress{n_samples},
+        option::MaxProgress{static_cast<size_t>(n_samples) - raw_data.size()},
         option::BarWidth{80}, // NOLINT(*-magic-numbers)
         option::ShowElapsedTime{true},
         option::ShowRemainingTime{true},
         option::FontStyles{std::vector<FontStyle>{FontStyle::bold}},
     };
-
-    tbb::parallel_for_each(
-        samples.begin(), samples.end(), [&](std::vector<UChar32> &sample) {
-            const std::vector<uint8_t> compressed = subset_font(face, sample);
-            {
-                std::lock_guard lock{results_mutex};
-                raw_data.emplace_back(sample.size(),
-                                      static_cast<double>(compressed.size()));
-                bar.tick();
+    std::mutex cache_mutex;
+
+    // One size per stratum and COST_MODEL_FOCUS_SAMPLES in the focus one
+    std::vector<size_t> round_strata(strata.size() - 1);
+    std::iota(round_strata.begin(), round_strata.end(), size_t(0));
+    round_strata.insert(round_strata.end(), COST_MODEL_FOCUS_SAMPLES,
+                        strata.size() - 1);
+
+    while (raw_data.size() < static_cast<size_t>(n_samples)) {
+        std::vector<std::vector<UChar32>> samples;
+        if (std::ranges::none_of(raw_data, [&](const auto &sample) {
+                return sample.first >= codepoints.size();
+            })) {
+            // The model is constant past its largest sample, so the first
+            // round also takes the whole universe
+            samples.emplace_back(codepoints.begin(), codepoints.end());
+        }
+        for (const size_t j : round_strata) {
+            if (raw_data.size() + samples.size() >=
+                static_cast<size_t>(n_samples)) {
+                break;
             }
+            const size_t n = std::uniform_int_distribution<size_t>{
+                strata[j].lo, strata[j].hi}(rng);
+            std::vector<UChar32> sample;
+            sample.reserve(n);
+            std::sample(codepoints.begin(), codepoints.end(),
+                        std::back_inserter(sample), n, rng);
+            samples.emplace_back(std::move(sample));
+        }
+
+        // Indexed by sample, so that a run from an empty cache is
+        // reproducible. The cache gets them as they complete, in no
+        // particular order, so that an interrupted run resumes from them.
+        std::vector<std::pair<size_t, double>> results(samples.size());
+        tbb::parallel_for(size_t(0), samples.size(), [&](size_t i) {
+            const std::vector<uint8_t> compressed =
+                subset_font(face, samples[i]);
+            results[i] = {samples[i].size(),
+                          static_cast<double>(compressed.size())};
+            std::lock_guard lock{cache_mutex};
+            cache.append(results[i].first, results[i].second);
+            bar.tick();
         });
+        raw_data.insert(raw_data.end(), results.begin(), results.end());
+
+        error = cost_model_error(raw_data, strata);
+        spdlog::debug("cost model: {} samples, {:.2f}% error",
+                      raw_data.size(), 100.0 * error);
+        if (error < COST_MODEL_TOLERANCE) {
+            break;
+        }
+    }
 
     bar.mark_as_completed();
+    spdlog::info("sampled {} subsets, {:.2f}% standard error, saved to {}",
+                 raw_data.size(), 100.0 * error, cache.path().string());
 
-    // Save the raw data to a cache file
-    {
-        json j;
-        j["raw_data"] = raw_data;
-        std::ofstream f{cache_path};
-        f << j.dump(4) << '\n';
-        spdlog::info("saved cost model raw data to {}", cache_path.string());
+    return build_cost_model_from_data(raw_data);
+}
+
+std::pair<FontLinearCostModel, std::vector<size_t>>
+build_outline_cost_model(hb_face_t *face, std::span<const UChar32> codepoints,
+                         unsigned long rng_seed) {
+    const std::vector<size_t> outline_sizes =
+        read_codepoint_outline_sizes(face, codepoints);
+    const double total_bytes =
+        ranges::accumulate(outline_sizes, 0.0) +
+        OUTLINE_GLYPH_OVERHEAD * static_cast<double>(codepoints.size());
+    const double unit = std::max(
+        1.0, total_bytes / (OUTLINE_UNITS_PER_GLYPH *
+                            static_cast<double>(codepoints.size())));
+    std::vector<size_t> sizes(codepoints.size());
+    for (size_t i = 0; i < codepoints.size(); i++) {
+        const double bytes =
+            static_cast<double>(outline_sizes[i]) + OUTLINE_GLYPH_OVERHEAD;
+        sizes[i] = std::max(size_t(1),
+                            static_cast<size_t>(std::lround(bytes / unit)));
     }
 
-    return build_cost_model_from_data(raw_data);
+    // Subsets from a few glyphs up to the whole universe, with sizes spaced
+    // geometrically so that both small and large partitions are covered
+    std::mt19937_64 rng{rng_seed};
+    std::vector<size_t> items(codepoints.size());
+    std::iota(items.begin(), items.end(), size_t(0));
+    std::vector<std::vector<size_t>> samples(OUTLINE_CALIBRATION_SAMPLES);
+    for (int k = 0; k < OUTLINE_CALIBRATION_SAMPLES; k++) {
+        const auto n = std::max(
+            size_t(1), static_cast<size_t>(std::ldexp(
+                           static_cast<double>(items.size()),
+                           k - OUTLINE_CALIBRATION_SAMPLES + 1)));
+        std::sample(items.begin(), items.end(),
+                    std::back_inserter(samples[k]), n, rng);
+    }
+    std::vector<std::pair<size_t, double>> raw_data(samples.size());
+    tbb::parallel_for(size_t(0), samples.size(), [&](size_t k) {
+        std::vector<UChar32> sample_codepoints;
+        size_t sample_size = 0;
+        for (const size_t i : samples[k]) {
+            sample_codepoints.push_back(codepoints[i]);
+            sample_size += sizes[i];
+        }
+        raw_data[k] = {sample_size, static_cast<double>(
+                                        subset_font(face, sample_codepoints)
+                                            .size())};
+    });
+
+    const FontLinearCostModel linear{raw_data};
+    double error = 0.0;
+    for (const auto &[size, bytes] : raw_data) {
+        error += std::abs(linear(size) - bytes) / bytes;
+    }
+    spdlog::info("outline cost model: y = {:.2f}x + {:.2f} with units of "
+                 "{:.1f} outline bytes, {:.1f}% mean error on {} subsets",
+                 linear.cost_per_glyph, linear.cost_base, unit,
+                 100.0 * error / static_cast<double>(raw_data.size()),
+                 raw_data.size());
+    return {linear, sizes};
 }
 
 std::pair<PartitionInstance, std::vector<UChar32>>
 create_partition_instance(const Input &input, const std::string &font_path,
-                          CostModel cost_model, size_t n_partitions) {
+                          CostModel cost_model, size_t n_partitions,
+                          std::span<const Session> sessions) {
     const std::vector<UChar32> item_to_codepoint =
         input.get_all_codepoints_sorted(font_path);
     const auto styles =
@@ -435,15 +1248,9 @@ create_partition_instance(const Input &input, const std::string &font_path,
         codepoint_to_item[item_to_codepoint[i]] = i;
     }
 
-    PartitionInstance instance{
-        .n_partitions = n_partitions,
-        .n_items = item_to_codepoint.size(),
-        .cost_model = cost_model,
-    };
-
-    for (const auto &[_, post] : input.posts) {
-        std::unordered_set<size_t> request;
-
+    // Appends the items of a post to request
+    const auto append_post_items = [&](const InputPost &post,
+                                       std::vector<size_t> &request) {
         for (const auto &style : styles) {
             if (const auto it = post.codepoints.find(style);
                 it != post.codepoints.end()) {
@@ -451,23 +1258,360 @@ create_partition_instance(const Input &input, const std::string &font_path,
                 for (it_ch.setToStart(); it_ch.hasNext();) {
                     const auto c = it_ch.next32PostInc();
                     assert(codepoint_to_item.contains(c));
-                    request.insert(codepoint_to_item[c]);
+                    request.push_back(codepoint_to_item[c]);
                 }
             }
         }
+    };
+
+    std::vector<double> weights;
+    CsrMatrix request_items;
 
-        if (!request.empty()) {
-            instance.requests.emplace_back(post.weight, std::move(request));
+    if (sessions.empty()) {
+        for (const auto &[_, post] : input.posts) {
+            std::vector<size_t> request;
+            append_post_items(post, request);
+            if (!request.empty()) {
+                weights.push_back(post.weight);
+                request_items.push_row(std::move(request));
+            }
+        }
+    } else {
+        size_t n_unknown = 0;
+        for (const Session &session : sessions) {
+            std::vector<size_t> request;
+            for (const std::string &key : session.posts) {
+                if (const auto it = input.posts.find(key);
+                    it != input.posts.end()) {
+                    append_post_items(it->second, request);
+                } else {
+                    n_unknown++;
+                }
+            }
+            ranges::sort(request);
+            request.erase(std::unique(request.begin(), request.end()),
+                          request.end());
+            if (!request.empty()) {
+                weights.push_back(session.count);
+                request_items.push_row(std::move(request));
+            }
+        }
+        if (n_unknown > 0) {
+            spdlog::warn("{} posts of sessions in the access log are not in "
+                         "the input, ignoring them",
+                         n_unknown);
         }
     }
+
     // Normalize weights
-    const double total_weight = ranges::accumulate(
-        instance.requests, 0.0,
-        [](double acc, const auto &req) { return acc + req.first; });
-    for (auto &[weight, _] : instance.requests) {
+    const double total_weight = ranges::accumulate(weights, 0.0);
+    for (auto &weight : weights) {
         weight /= total_weight;
     }
-    return {instance, item_to_codepoint};
+    return {PartitionInstance::from_csr(
+                n_partitions, item_to_codepoint.size(), std::move(weights),
+                std::move(request_items), std::move(cost_model)),
+            item_to_codepoint};
+}
+
+PartitionSoln solve_partition_instance(
+    PartitionInstance &instance, size_t max_partitions,
+    const argparse::ArgumentParser &program, const SolveControl &control,
+    std::optional<PartitionSoln> initial_soln) {
+    CoarsenedInstance coarse = coarsen_instance(instance);
+    PartitionInstance &reduced = coarse.instance;
+    SolveControl reduced_control = control;
+    if (control.checkpoint) {
+        reduced_control.checkpoint = [&](const PartitionSoln &soln) {
+            control.checkpoint(coarse.project(soln));
+        };
+    }
+
+    // Logs the cost of a solution and its gap to the lower bound for the
+    // current number of partitions, relative to the cost
+    const auto log_cost = [&](std::string_view name,
+                              const PartitionSoln &soln) {
+        const double cost = reduced.eval(soln);
+        const double gap =
+            cost > 0.0 ? (cost - reduced.lower_bound()) / cost : 0.0;
+        spdlog::info("{} cost: {} (gap {:.2f}%)", name, cost, 100.0 * gap);
+    };
+    // The solvers stop once within --gap-tolerance of the lower bound. The
+    // bound depends on the number of partitions, so this is only set once
+    // that is known.
+    const auto gap_tolerance = program.present<double>("--gap-tolerance");
+    const auto update_target_cost = [&] {
+        if (gap_tolerance) {
+            reduced_control.target_cost =
+                reduced.lower_bound() / (1.0 - *gap_tolerance);
+        }
+    };
+
+    // Starting point of the heuristic and minibatch solvers, and of the
+    // coarsest level of the multilevel solver
+    const auto initial_solution =
+        program.get<std::string>("--initial-solution");
+    const InitialSolver initial_solver = initial_solution == "greedy"
+                                             ? partition_solve_greedy
+                                             : partition_solve_baseline;
+    const auto solve_initial = [&] {
+        PartitionSoln soln = initial_solver(reduced);
+        log_cost(initial_solution, soln);
+        return soln;
+    };
+
+    PartitionSoln soln;
+    if (initial_soln.has_value()) {
+        reduced.n_partitions = initial_soln->n_partitions;
+        update_target_cost();
+        const PartitionSoln soln_resumed = coarse.restrict(*initial_soln);
+        log_cost(reduced.has_change_cost() ? "previous" : "resumed",
+                 soln_resumed);
+        soln = partition_refine_fm(
+            reduced,
+            partition_solve_heuristic(reduced, soln_resumed, reduced_control),
+            reduced_control);
+        log_cost("refined", soln);
+    } else if (max_partitions > reduced.n_partitions) {
+        std::vector<PartitionSweepPoint> sweep =
+            partition_sweep(reduced, max_partitions, reduced_control);
+        const size_t selected = partition_sweep_select(
+            sweep, program.present<double>("--n-partitions-tolerance"));
+        spdlog::info("selected {} partitions (cost {})",
+                     sweep[selected].n_partitions, sweep[selected].cost);
+        reduced.n_partitions = sweep[selected].n_partitions;
+        soln = std::move(sweep[selected].soln);
+        update_target_cost();
+    } else if (program.get<std::string>("--solver") == "multilevel") {
+        update_target_cost();
+        soln = partition_solve_multilevel(reduced, initial_solver,
+                                          reduced_control);
+        log_cost("multilevel", soln);
+    } else if (program.get<std::string>("--solver") == "minibatch") {
+        update_target_cost();
+        const MinibatchOptions minibatch_options{
+            .batch_size =
+                static_cast<size_t>(program.get<int>("--batch-size")),
+            .seed = static_cast<uint64_t>(program.get<int>("--rng")),
+        };
+        soln = partition_solve_minibatch(reduced, solve_initial(),
+                                         minibatch_options, reduced_control);
+        log_cost("minibatch", soln);
+    } else {
+        update_target_cost();
+        const PartitionSoln soln_heuristic = partition_solve_heuristic(
+            reduced, solve_initial(), reduced_control);
+        log_cost("heuristic", soln_heuristic);
+        soln = partition_refine_fm(reduced, soln_heuristic, reduced_control);
+        log_cost("refined", soln);
+    }
+
+    bool optimal = false;
+    // The exact solver does not know about size bounds, the CSS cost or the
+    // change cost
+    if (reduced.n_items <= EXACT_MAX_ITEMS && !reduced.has_size_bounds() &&
+        !reduced.has_css_cost() && !reduced.has_change_cost()) {
+        std::tie(soln, optimal) =
+            partition_solve_exact(reduced, std::move(soln), reduced_control);
+        log_cost(optimal ? "optimal" : "exact", soln);
+    }
+
+    const AnnealingOptions annealing_options{
+        .time_budget = std::chrono::duration<double>{
+            program.get<double>("--solve-time")},
+        .n_chains = static_cast<size_t>(program.get<int>("--solve-chains")),
+        .seed = static_cast<uint64_t>(program.get<int>("--rng")),
+    };
+    if (annealing_options.time_budget.count() > 0 && !optimal) {
+        soln = partition_solve_annealing(reduced, std::move(soln),
+                                         annealing_options, reduced_control);
+        log_cost("annealing", soln);
+    }
+
+    // The solvers above minimize the mean. Other objectives are minimized
+    // from there with the heuristic and FM on reweighted requests, which
+    // stop at local optima rather than at the gap target of the mean.
+    if (reduced.objective.kind != Objective::Kind::Mean) {
+        const auto objective = program.get<std::string>("--objective");
+        spdlog::info("{} objective: {}", objective,
+                     reduced.eval_objective(soln));
+        SolveControl objective_control = reduced_control;
+        objective_control.target_cost = 0.0;
+        soln = partition_solve_objective(
+            reduced, std::move(soln),
+            [&](const PartitionInstance &linearized, PartitionSoln start) {
+                return partition_refine_fm(
+                    linearized,
+                    partition_solve_heuristic(linearized, std::move(start),
+                                              objective_control),
+                    objective_control);
+            },
+            objective_control);
+        spdlog::info("{} objective: {}", objective,
+                     reduced.eval_objective(soln));
+        log_cost("objective", soln);
+    }
+
+    instance.n_partitions = reduced.n_partitions;
+    // The solvers do not take a solution further outside the size bounds,
+    // but do not bring it within them either. Starting them from a repaired
+    // solution instead leaves them little room to move.
+    if (reduced.has_size_bounds()) {
+        soln = partition_repair_sizes(reduced, std::move(soln));
+        log_cost("within size bounds", soln);
+    }
+    if (reduced.has_change_cost()) {
+        if (const auto max_changed_bytes =
+                program.present<double>("--max-changed-bytes")) {
+            SolveControl limit_control = reduced_control;
+            limit_control.target_cost = 0.0;
+            soln = partition_limit_changes(
+                reduced, std::move(soln),
+                [&](const PartitionInstance &penalized, PartitionSoln start) {
+                    PartitionSoln result = partition_refine_fm(
+                        penalized,
+                        partition_solve_heuristic(
+                            penalized, std::move(start), limit_control),
+                        limit_control);
+                    return penalized.has_size_bounds()
+                               ? partition_repair_sizes(penalized,
+                                                        std::move(result))
+                               : result;
+                },
+                *max_changed_bytes, limit_control);
+            log_cost("within change limit", soln);
+        }
+        spdlog::info("{} bytes of previous partitions changed",
+                     reduced.changed_bytes(soln));
+    }
+    return coarse.project(soln);
+}
+
+std::optional<PartitionSoln>
+read_checkpoint(const std::filesystem::path &path, const std::string &font_path,
+                std::span<const UChar32> item_to_codepoint) {
+    std::ifstream f{path};
+    if (!f) {
+        spdlog::warn("checkpoint {} not found", path.string());
+        return std::nullopt;
+    }
+    const json j = json::parse(f);
+    if (!j.contains(font_path) || j[font_path].empty()) {
+        return std::nullopt;
+    }
+    const auto partitions =
+        j[font_path].get<std::vector<std::vector<UChar32>>>();
+    std::unordered_map<UChar32, size_t> codepoint_to_partition;
+    for (size_t k = 0; k < partitions.size(); k++) {
+        for (const UChar32 c : partitions[k]) {
+            codepoint_to_partition[c] = k;
+        }
+    }
+    spdlog::info("resuming from {} with {} partitions", path.string(),
+                 partitions.size());
+    return PartitionSoln{
+        .n_partitions = partitions.size(),
+        .item_to_partition =
+            item_to_codepoint | ranges::views::transform([&](UChar32 c) {
+                const auto it = codepoint_to_partition.find(c);
+                return it == codepoint_to_partition.end() ? size_t(0)
+                                                          : it->second;
+            }) |
+            ranges::to<std::vector>(),
+    };
+}
+
+void write_checkpoint(const std::filesystem::path &path,
+                      const std::string &font_path, const PartitionSoln &soln,
+                      std::span<const UChar32> item_to_codepoint) {
+    json j = json::object();
+    if (std::ifstream f{path}; f) {
+        j = json::parse(f);
+    }
+    j[font_path] = soln.partitions() |
+                   ranges::views::transform([&](const auto &items) {
+                       return items |
+                              ranges::views::transform([&](size_t item) {
+                                  return item_to_codepoint[item];
+                              }) |
+                              ranges::to<std::vector>();
+                   }) |
+                   ranges::to<std::vector>();
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream f{temp_path};
+        f << j.dump() << '\n';
+    }
+    std::filesystem::rename(temp_path, path);
+    spdlog::debug("saved checkpoint to {}", path.string());
+}
+
+std::unordered_map<std::string, std::vector<PreviousPartition>>
+read_previous_build(const std::filesystem::path &path) {
+    const std::filesystem::path manifest_path =
+        std::filesystem::is_directory(path) ? path / "manifest.json" : path;
+    std::ifstream f{manifest_path};
+    if (!f) {
+        throw std::runtime_error(fmt::format("could not open manifest {}",
+                                             manifest_path.string()));
+    }
+    const json j = json::parse(f);
+    std::unordered_map<std::string, std::vector<PreviousPartition>> result;
+    size_t n_files = 0;
+    for (const auto &[font_path, entries] : j.items()) {
+        auto &partitions = result[font_path];
+        for (const auto &entry : entries) {
+            PreviousPartition partition{
+                .filename = entry.at("file").get<std::string>(),
+                .codepoints =
+                    entry.at("codepoints").get<std::vector<UChar32>>(),
+                .data = {},
+            };
+            ranges::sort(partition.codepoints);
+            const auto file_path =
+                manifest_path.parent_path() / partition.filename;
+            std::ifstream file{file_path, std::ios::binary};
+            if (!file) {
+                throw std::runtime_error(
+                    fmt::format("could not open {} of the previous build",
+                                file_path.string()));
+            }
+            partition.data.assign(std::istreambuf_iterator<char>{file},
+                                  std::istreambuf_iterator<char>{});
+            partitions.push_back(std::move(partition));
+            n_files++;
+        }
+    }
+    spdlog::info("read {} fonts and {} partition files from {}",
+                 result.size(), n_files, manifest_path.string());
+    return result;
+}
+
+void write_manifest(const std::filesystem::path &output_path,
+                    const std::string &font_path,
+                    const FontPartitionSoln &soln,
+                    std::span<const UChar32> item_to_codepoint) {
+    std::vector<std::vector<UChar32>> codepoints(soln.subsetted_fonts.size());
+    for (const UChar32 c : item_to_codepoint) {
+        codepoints[soln.codepoint_to_partition.at(c)].push_back(c);
+    }
+    json entries = json::array();
+    for (size_t k = 0; k < soln.subsetted_fonts.size(); k++) {
+        entries.push_back({
+            {"file", soln.subsetted_fonts[k].first},
+            {"codepoints", codepoints[k]},
+        });
+    }
+    // One entry per font, so read back what earlier fonts wrote
+    const auto manifest_path = output_path / "manifest.json";
+    json j = json::object();
+    if (std::ifstream f{manifest_path}; f) {
+        j = json::parse(f);
+    }
+    j[font_path] = std::move(entries);
+    std::ofstream f{manifest_path};
+    f << j.dump() << '\n';
 }
 
 template <typename T> std::string pretty_print_size(T size_) {
@@ -555,10 +1699,104 @@ get_incompatible_styles(const Input &input, const std::string &font_path) {
     return result;
 }
 
+void set_css_cost(PartitionInstance &instance, const Input &input,
+                  const std::string &font_path,
+                  std::span<const UChar32> item_to_codepoint, double css_weight,
+                  unsigned long rng_seed) {
+    const size_t n = item_to_codepoint.size();
+    const size_t n_parts = instance.n_partitions;
+    if (css_weight <= 0.0 || n <= n_parts) {
+        return;
+    }
+    const auto styles = get_incompatible_styles(input, font_path);
+    const std::string output_base =
+        std::filesystem::path{font_path}.stem().string();
+    // Gzipped CSS of the partitions of codepoints given by part, and its
+    // number of runs
+    const auto css_size = [&](std::span<const size_t> part) {
+        std::vector<std::vector<UChar32>> partitions(n_parts);
+        for (size_t x = 0; x < n; x++) {
+            partitions[part[x]].push_back(item_to_codepoint[x]);
+        }
+        std::string css;
+        for (size_t k = 0; k < n_parts; k++) {
+            for (const auto &css_kv : styles) {
+                css += generate_css(
+                    fmt::format("./{}-{:02}.woff2", output_base, k),
+                    partitions[k], css_kv);
+            }
+        }
+        return static_cast<double>(gzip_string(css).size());
+    };
+
+    std::vector<size_t> part(n);
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t x = 0; x < n; x++) {
+        part[x] = x * n_parts / n;
+        if (x + 1 < n && item_to_codepoint[x + 1] == item_to_codepoint[x] + 1) {
+            pairs.emplace_back(x, x + 1);
+        }
+    }
+    instance.css_cost = CssCost::from_pairs(n, pairs, n, 0.0);
+    const double contiguous_size = css_size(part);
+    const auto contiguous_runs = static_cast<double>(instance.css_runs(part));
+    std::mt19937_64 rng{rng_seed};
+    std::uniform_int_distribution<size_t> part_dist{0, n_parts - 1};
+    for (size_t &k : part) {
+        k = part_dist(rng);
+    }
+    const double random_size = css_size(part);
+    const auto random_runs = static_cast<double>(instance.css_runs(part));
+    if (random_runs <= contiguous_runs) {
+        return;
+    }
+    instance.css_cost.bytes_per_run =
+        css_weight * std::max(0.0, random_size - contiguous_size) /
+        (random_runs - contiguous_runs);
+    spdlog::info("estimated {:.2f} bytes of gzipped CSS per unicode-range run",
+                 instance.css_cost.bytes_per_run);
+}
+
+void set_change_cost(PartitionInstance &instance,
+                     std::span<const UChar32> item_to_codepoint,
+                     std::span<const PreviousPartition> previous,
+                     double penalty) {
+    std::unordered_map<UChar32, size_t> codepoint_to_partition;
+    for (size_t k = 0; k < previous.size(); k++) {
+        for (const UChar32 c : previous[k].codepoints) {
+            codepoint_to_partition[c] = k;
+        }
+    }
+    std::vector<size_t> item_to_partition(instance.n_items);
+    size_t n_new = 0;
+    for (size_t x = 0; x < instance.n_items; x++) {
+        const auto it = codepoint_to_partition.find(item_to_codepoint[x]);
+        if (it == codepoint_to_partition.end()) {
+            item_to_partition[x] = ChangeCost::NEW;
+            n_new++;
+        } else {
+            item_to_partition[x] = it->second;
+        }
+    }
+    std::vector<double> partition_bytes =
+        previous | ranges::views::transform([](const auto &partition) {
+            return static_cast<double>(partition.data.size());
+        }) |
+        ranges::to<std::vector>();
+    instance.n_partitions = previous.size() + 1;
+    instance.change_cost = ChangeCost::from_previous(
+        instance, std::move(item_to_partition), std::move(partition_bytes),
+        penalty);
+    spdlog::info("starting from {} previous partitions, with {} new "
+                 "codepoints in a partition of their own",
+                 previous.size(), n_new);
+}
+
 FontPartitionSoln FontPartitionSoln::from_partition_soln(
     const Input &input, const std::string &font_path, hb_face_t *face,
     const PartitionInstance &instance, const PartitionSoln &soln,
-    std::span<const UChar32> item_to_codepoint) {
+    std::span<const UChar32> item_to_codepoint,
+    std::span<const PreviousPartition> previous) {
     using namespace ranges;
 
     const auto map = [](auto &mapping) {
@@ -570,20 +1808,49 @@ FontPartitionSoln FontPartitionSoln::from_partition_soln(
     const std::string output_base =
         std::filesystem::path{font_path}.stem().string();
 
+    const std::vector<std::vector<size_t>> partitions = soln.partitions();
+
     // Generate font subsets in parallel
     std::vector<std::pair<std::string, std::vector<uint8_t>>> subsetted_fonts(
-        soln.partitions.size());
-    tbb::parallel_for(size_t(0), soln.partitions.size(), [&](size_t i) {
-        if (soln.partitions[i].empty()) {
+        partitions.size());
+    tbb::parallel_for(size_t(0), partitions.size(), [&](size_t i) {
+        if (partitions[i].empty()) {
             return; // Skip empty partitions
         }
         const auto codepoints =
-            soln.partitions[i] | map(item_to_codepoint) | to<std::vector>;
+            partitions[i] | map(item_to_codepoint) | to<std::vector>;
+        // Codepoints that are no longer used may stay in the previous file
+        if (i < previous.size() &&
+            ranges::equal(previous[i].codepoints |
+                              views::filter([&](UChar32 c) {
+                                  return std::ranges::binary_search(
+                                      item_to_codepoint, c);
+                              }),
+                          codepoints)) {
+            subsetted_fonts[i] = {previous[i].filename, previous[i].data};
+            return;
+        }
         const std::vector<uint8_t> subsetted_font =
             subset_font(face, codepoints);
-        subsetted_fonts[i] = {fmt::format("{}-{:02}.woff2", output_base, i),
-                              subsetted_font};
+        // Browsers and CDNs may have cached the files of the previous build
+        // under their names, so new contents need new names
+        const std::string filename =
+            previous.empty()
+                ? fmt::format("{}-{:02}.woff2", output_base, i)
+                : fmt::format("{}-{:02}-{:08x}.woff2", output_base, i,
+                              content_hash(subsetted_font));
+        subsetted_fonts[i] = {filename, subsetted_font};
     });
+    if (!previous.empty()) {
+        const auto is_reused = [&](const auto &font) {
+            return std::ranges::any_of(previous, [&](const auto &partition) {
+                return partition.filename == font.first;
+            });
+        };
+        const auto n_reused = std::ranges::count_if(subsetted_fonts, is_reused);
+        spdlog::info("reused {} of {} partition files of the previous build",
+                     n_reused, previous.size());
+    }
 
     // Generate css
     std::string css = "";
@@ -593,16 +1860,19 @@ FontPartitionSoln FontPartitionSoln::from_partition_soln(
     const std::vector<std::map<std::string, std::string>> styles_css =
         get_incompatible_styles(input, font_path);
 
-    for (size_t i = 0; i < soln.partitions.size(); i++) {
-        if (soln.partitions[i].empty()) {
+    // Partitions are numbered without the empty ones, like subsetted_fonts
+    size_t n_nonempty = 0;
+    for (size_t i = 0; i < partitions.size(); i++) {
+        if (partitions[i].empty()) {
             continue;
         }
         std::vector<UChar32> codepoints =
-            soln.partitions[i] | map(item_to_codepoint) | to<std::vector>;
+            partitions[i] | map(item_to_codepoint) | to<std::vector>;
         ranges::sort(codepoints);
         for (const auto c : codepoints) {
-            codepoints_to_partition[c] = i;
+            codepoints_to_partition[c] = n_nonempty;
         }
+        n_nonempty++;
         const auto font_output_path =
             fmt::format("./{}", subsetted_fonts[i].first);
         for (const auto &css_kvs : styles_css) {
@@ -622,7 +1892,8 @@ void save_and_evaluate_solution(const Input &input,
                                 const PartitionInstance &instance,
                                 const PartitionSoln &partition_soln,
                                 std::span<const UChar32> item_to_codepoint,
-                                const argparse::ArgumentParser &program) {
+                                const argparse::ArgumentParser &program,
+                                std::span<const PreviousPartition> previous) {
     const std::filesystem::path output_path{
         program.get<std::string>("--output")};
 
@@ -645,7 +1916,8 @@ void save_and_evaluate_solution(const Input &input,
         });
     }
     FontPartitionSoln soln = FontPartitionSoln::from_partition_soln(
-        input, font_path, face, instance, partition_soln, item_to_codepoint);
+        input, font_path, face, instance, partition_soln, item_to_codepoint,
+        previous);
     g.wait();
 
     for (const auto &[filename, subsetted_font] : soln.subsetted_fonts) {
@@ -661,31 +1933,63 @@ void save_and_evaluate_solution(const Input &input,
         std::ofstream f{css_output_path, std::ios::app};
         f << soln.css;
     }
+    write_manifest(output_path, font_path, soln, item_to_codepoint);
 
     using namespace ranges;
 
-    const auto map = [](auto &mapping) {
-        return views::transform([&mapping](auto i) { return mapping[i]; });
-    };
-
-    const auto compute_total_cost = [&](FontPartitionSoln &soln) {
-        return accumulate(
-            instance.requests | views::transform([&](const auto &req) {
-                const auto &[weight, items] = req;
-                const std::unordered_set<size_t> partitions =
-                    items | map(item_to_codepoint) |
-                    map(soln.codepoint_to_partition) | to<std::unordered_set>;
-                const auto subset_size = [&](size_t i) {
-                    return soln.subsetted_fonts[i].second.size();
-                };
-                return weight *
-                       accumulate(partitions | views::transform(subset_size),
-                                  0.0);
-            }),
-            0.0);
+    // Evaluates a solution with the real sizes of its subsetted fonts, plus
+    // request_cost bytes per font request
+    const auto evaluate = [&](const FontPartitionSoln &soln,
+                              double request_cost = 0.0) {
+        const PartitionSoln assignment{
+            .n_partitions = soln.subsetted_fonts.size(),
+            // Codepoints not covered by any subset (only possible with the
+            // Google Fonts baseline) are counted in the first one
+            .item_to_partition =
+                item_to_codepoint | views::transform([&](UChar32 c) {
+                    const auto it = soln.codepoint_to_partition.find(c);
+                    return it == soln.codepoint_to_partition.end() ? size_t(0)
+                                                                   : it->second;
+                }) |
+                to<std::vector>(),
+        };
+        const std::vector<double> partition_costs =
+            soln.subsetted_fonts | views::transform([&](const auto &font) {
+                return static_cast<double>(font.second.size()) + request_cost;
+            }) |
+            to<std::vector>();
+        return instance.eval_report(assignment, partition_costs);
     };
 
-    const double total_cost = compute_total_cost(soln);
+    const EvalReport report = evaluate(soln);
+    // The size bounds were enforced on predicted sizes, so check the real ones
+    const auto min_bytes = program.present<double>("--min-partition-bytes");
+    const auto max_bytes = program.present<double>("--max-partition-bytes");
+    for (const auto &[filename, subsetted_font] : soln.subsetted_fonts) {
+        const double size = static_cast<double>(subsetted_font.size());
+        if (min_bytes && size < *min_bytes) {
+            spdlog::warn("{} has {} bytes, below --min-partition-bytes",
+                         filename, subsetted_font.size());
+        }
+        if (max_bytes && size > *max_bytes) {
+            spdlog::warn("{} has {} bytes, above --max-partition-bytes",
+                         filename, subsetted_font.size());
+        }
+    }
+    // Load times, if a network is given. Requests are assumed to be sent one
+    // after the other, so that their latencies add up.
+    const NetworkProfile network = parse_network_profile(program);
+    std::optional<WeightedSummary> seconds_per_page;
+    if (network.bytes_per_second > 0.0) {
+        WeightedSummary summary =
+            evaluate(soln, network.request_cost()).cost;
+        for (double *value : {&summary.mean, &summary.p50, &summary.p95,
+                              &summary.p99, &summary.max}) {
+            *value /= network.bytes_per_second;
+        }
+        seconds_per_page = summary;
+    }
+    const double total_cost = report.total;
     const double total_cost_with_css =
         total_cost + static_cast<double>(gzip_string(soln.css).size());
 
@@ -723,9 +2027,58 @@ void save_and_evaluate_solution(const Input &input,
                      pretty_print_size(total_cost_with_css));
     }
 
+    spdlog::info("bytes per page             : mean {}, p50 {}, p95 {}, "
+                 "p99 {}, max {}",
+                 pretty_print_size(report.cost.mean),
+                 pretty_print_size(report.cost.p50),
+                 pretty_print_size(report.cost.p95),
+                 pretty_print_size(report.cost.p99),
+                 pretty_print_size(report.cost.max));
+    spdlog::info("partitions per page        : mean {:.2f}, p50 {}, p95 {}, "
+                 "p99 {}, max {}",
+                 report.partitions.mean, report.partitions.p50,
+                 report.partitions.p95, report.partitions.p99,
+                 report.partitions.max);
+    if (seconds_per_page) {
+        spdlog::info("seconds per page           : mean {:.3f}, p50 {:.3f}, "
+                     "p95 {:.3f}, p99 {:.3f}, max {:.3f}",
+                     seconds_per_page->mean, seconds_per_page->p50,
+                     seconds_per_page->p95, seconds_per_page->p99,
+                     seconds_per_page->max);
+    }
+
+    if (program.get<bool>("--report")) {
+        const auto summary_json = [](const WeightedSummary &summary) {
+            return json{
+                {"mean", summary.mean}, {"p50", summary.p50},
+                {"p95", summary.p95},   {"p99", summary.p99},
+                {"max", summary.max},
+            };
+        };
+        // One entry per font, so read back what earlier fonts wrote
+        const auto report_path = output_path / "report.json";
+        json j = json::object();
+        if (std::ifstream f{report_path}; f) {
+            j = json::parse(f);
+        }
+        j[font_path] = {
+            {"n_partitions", soln.subsetted_fonts.size()},
+            {"predicted_cost", instance.eval(partition_soln)},
+            {"total_cost", total_cost},
+            {"total_cost_with_css", total_cost_with_css},
+            {"bytes_per_page", summary_json(report.cost)},
+            {"partitions_per_page", summary_json(report.partitions)},
+        };
+        if (seconds_per_page) {
+            j[font_path]["seconds_per_page"] = summary_json(*seconds_per_page);
+        }
+        std::ofstream f{report_path};
+        f << j.dump(4) << '\n';
+    }
+
     if (soln_google_fonts.has_value()) {
         const double total_cost_google_fonts_with_css =
-            compute_total_cost(*soln_google_fonts) +
+            evaluate(*soln_google_fonts).total +
             static_cast<double>(gzip_string(soln_google_fonts->css).size());
         const double reduction =
             (total_cost_google_fonts_with_css - total_cost_with_css) /
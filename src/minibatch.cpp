@@ -0,0 +1,161 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <range/v3/algorithm/sort.hpp>
+
+#include "item_move_state.h"
+
+using namespace optift;
+
+namespace {
+
+/**
+ * Refills batch with a draw of requests with probability proportional to their
+ * weight, over the same items as the instance. Every draw gets the same
+ * weight, so that the cost of a solution on the batch is an unbiased estimate
+ * of its cost on the whole instance. Requests drawn more than once are merged.
+ * Only the requests and weights of the batch are refilled, reusing their
+ * storage.
+ *
+ * \param cumulative_weights Prefix sums of the request weights
+ */
+void draw_batch(const PartitionInstance &instance,
+                std::span<const double> cumulative_weights, size_t batch_size,
+                std::mt19937_64 &rng, PartitionInstance &batch) {
+    const double total_weight = cumulative_weights.back();
+    std::uniform_real_distribution<double> dist{0.0, total_weight};
+    std::vector<size_t> draws(batch_size);
+    for (size_t &u : draws) {
+        const auto it = std::upper_bound(cumulative_weights.begin(),
+                                         cumulative_weights.end(), dist(rng));
+        u = std::min(static_cast<size_t>(it - cumulative_weights.begin()),
+                     instance.n_requests() - 1);
+    }
+    ranges::sort(draws);
+
+    const double draw_weight = total_weight / static_cast<double>(batch_size);
+    batch.weights.clear();
+    batch.request_items.offsets.assign(1, 0);
+    batch.request_items.indices.clear();
+    for (size_t k = 0; k < draws.size(); k++) {
+        if (k > 0 && draws[k] == draws[k - 1]) {
+            batch.weights.back() += draw_weight;
+            continue;
+        }
+        // Rows of the instance are already sorted and deduplicated
+        const auto row = instance.request_items.row(draws[k]);
+        batch.weights.push_back(draw_weight);
+        batch.request_items.indices.insert(batch.request_items.indices.end(),
+                                           row.begin(), row.end());
+        batch.request_items.offsets.push_back(
+            batch.request_items.indices.size());
+    }
+    batch.request_items.transpose_into(batch.n_items, batch.item_requests);
+}
+
+/**
+ * Makes one pass over the items of the batch in random order, moving each to
+ * the partition that most decreases the cost of the batch. Items that are not
+ * in any request of the batch stay put, since the batch says nothing about
+ * their requests.
+ *
+ * \param state Move state over the batch, which is reset to soln
+ */
+template <typename Cost>
+void improve_on_batch(ItemMoveState<Cost> &state, PartitionSoln &soln,
+                      std::mt19937_64 &rng) {
+    state.reset(soln);
+    std::vector<size_t> items = state.instance.request_items.indices;
+    ranges::sort(items);
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+    std::shuffle(items.begin(), items.end(), rng);
+    for (const size_t x : items) {
+        if (const auto [delta, b] = state.best_move(x); delta < 0.0) {
+            state.apply_move(x, b, [](size_t) {});
+        }
+    }
+    soln.item_to_partition = state.part;
+}
+
+} // namespace
+
+PartitionSoln
+optift::partition_solve_minibatch(const PartitionInstance &instance,
+                                  PartitionSoln initial_soln,
+                                  const MinibatchOptions &options,
+                                  const SolveControl &control) {
+    if (instance.n_requests() == 0) {
+        return initial_soln;
+    }
+    std::vector<double> cumulative_weights(instance.n_requests());
+    double total_weight = 0.0;
+    for (size_t u = 0; u < instance.n_requests(); u++) {
+        total_weight += instance.weights[u];
+        cumulative_weights[u] = total_weight;
+    }
+    std::mt19937_64 rng{options.seed};
+
+    // Everything but the requests and weights is the same for all batches,
+    // so the batch is set up once and refilled every round
+    PartitionInstance batch = PartitionInstance::from_csr(
+        instance.n_partitions, instance.n_items, {}, {}, instance.cost_model);
+    batch.item_sizes = instance.item_sizes;
+    batch.min_partition_size = instance.min_partition_size;
+    batch.max_partition_size = instance.max_partition_size;
+    batch.css_cost = instance.css_cost;
+    batch.change_cost = instance.change_cost;
+
+    PartitionSoln best = std::move(initial_soln);
+    double best_cost = instance.eval(best);
+    PartitionSoln soln = best;
+
+    // The cost model is tabulated once for all rounds
+    visit_cost_model(instance, [&](const auto &cost) {
+        // The state takes the CSS cost from the weights of the first batch.
+        // Every batch has the total weight of the instance, so it holds for
+        // the later ones too.
+        draw_batch(instance, cumulative_weights, options.batch_size, rng,
+                   batch);
+        ItemMoveState state{batch, soln, cost};
+        size_t n_stale = 0;
+        for (size_t round = 1; n_stale < options.patience; round++) {
+            if (control.should_stop() || control.reached_target(best_cost)) {
+                spdlog::info("minibatch stopped early after {} rounds",
+                             round - 1);
+                break;
+            }
+            if (round > 1) {
+                draw_batch(instance, cumulative_weights, options.batch_size,
+                           rng, batch);
+            }
+            improve_on_batch(state, soln, rng);
+
+            if (round % options.validation_interval != 0) {
+                continue;
+            }
+            if (const double cost = instance.eval(soln); cost < best_cost) {
+                spdlog::info("minibatch round {}: cost {} -> {}", round,
+                             best_cost, cost);
+                best_cost = cost;
+                best = soln;
+                n_stale = 0;
+                control.maybe_checkpoint([&] { return best; });
+            } else {
+                // The batches since the last validation overfit, roll them
+                // back
+                spdlog::debug("minibatch round {}: cost {} rejected (best {})",
+                              round, cost, best_cost);
+                soln = best;
+                n_stale++;
+            }
+        }
+    });
+    return best;
+}
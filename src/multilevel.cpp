@@ -0,0 +1,217 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+
+#include <range/v3/algorithm/sort.hpp>
+#include <range/v3/numeric/accumulate.hpp>
+
+using namespace optift;
+
+// Coarsening stops once there are at most this many items per partition
+constexpr size_t ML_COARSEST_ITEMS_PER_PARTITION = 32;
+// Coarsening also stops when a level removes less than this fraction of items
+constexpr double ML_MIN_SHRINK = 0.05;
+// At most this many requests of an item are scanned to rate its neighbors.
+// Items in more requests are rated on an evenly strided sample.
+constexpr size_t ML_MAX_RATED_REQUESTS = 32;
+// A coarse item may hold at most this fraction of the glyphs of an average
+// partition, so that the coarsest level still has room to move items around
+constexpr double ML_MAX_CLUSTER_SHARE = 0.5;
+
+namespace {
+
+/// Per-thread scratch buffers for rating neighbors of an item.
+struct RatingScratch {
+    std::vector<double> rating;
+    std::vector<size_t> touched;
+};
+
+/// The neighbor an item would most like to be merged with.
+struct Partner {
+    double rating = 0.0;
+    size_t item = 0;
+};
+
+/**
+ * Finds for every item the neighbor with the most similar requests, by the
+ * weighted Jaccard similarity of their request sets.
+ *
+ * \param max_size Pairs whose total size exceeds this are not considered
+ */
+std::vector<Partner> find_partners(const PartitionInstance &instance,
+                                   size_t max_size) {
+    const size_t n = instance.n_items;
+    // Total weight of the requests of each item
+    std::vector<double> item_weights(n, 0.0);
+    for (size_t x = 0; x < n; x++) {
+        for (const size_t u : instance.item_requests.row(x)) {
+            item_weights[x] += instance.weights[u];
+        }
+    }
+
+    std::vector<Partner> partners(n);
+    tbb::enumerable_thread_specific<RatingScratch> scratch{[&] {
+        return RatingScratch{std::vector<double>(n, 0.0), {}};
+    }};
+    tbb::parallel_for(size_t(0), n, [&](size_t x) {
+        auto &[rating, touched] = scratch.local();
+        const auto reqs = instance.item_requests.row(x);
+        const size_t stride = std::max<size_t>(
+            1, (reqs.size() + ML_MAX_RATED_REQUESTS - 1) /
+                   ML_MAX_RATED_REQUESTS);
+        double sampled_weight = 0.0;
+        for (size_t k = 0; k < reqs.size(); k += stride) {
+            const size_t u = reqs[k];
+            sampled_weight += instance.weights[u];
+            for (const size_t y : instance.request_items.row(u)) {
+                if (y == x ||
+                    instance.item_sizes[x] + instance.item_sizes[y] >
+                        max_size) {
+                    continue;
+                }
+                if (rating[y] == 0.0) {
+                    touched.push_back(y);
+                }
+                rating[y] += instance.weights[u];
+            }
+        }
+        // Scale the sampled co-occurrence weight back up to all requests of x
+        const double scale =
+            sampled_weight > 0.0 ? item_weights[x] / sampled_weight : 0.0;
+        Partner &best = partners[x];
+        for (const size_t y : touched) {
+            const double common = std::min(
+                {rating[y] * scale, item_weights[x], item_weights[y]});
+            const double similarity =
+                common / (item_weights[x] + item_weights[y] - common);
+            // Ties go to the lowest item, so that the result is deterministic
+            if (similarity > best.rating ||
+                (similarity == best.rating && y < best.item)) {
+                best = {similarity, y};
+            }
+            rating[y] = 0.0;
+        }
+        touched.clear();
+    });
+    return partners;
+}
+
+/**
+ * Clusters items with their preferred partners. Pairs are visited from the
+ * most to the least similar; an item joins the cluster of its partner unless
+ * it is already clustered or the cluster would become too large.
+ *
+ * \return A pair of a vector mapping each item to its cluster, and the number
+ *   of clusters. Clusters are numbered in order of their first item.
+ */
+std::pair<std::vector<size_t>, size_t>
+cluster_items(const PartitionInstance &instance, size_t max_size) {
+    const size_t n = instance.n_items;
+    const std::vector<Partner> partners = find_partners(instance, max_size);
+
+    std::vector<size_t> order;
+    for (size_t x = 0; x < n; x++) {
+        if (partners[x].rating > 0.0) {
+            order.push_back(x);
+        }
+    }
+    ranges::sort(order, [&](size_t a, size_t b) {
+        return std::pair{-partners[a].rating, a} <
+               std::pair{-partners[b].rating, b};
+    });
+
+    // leader[x] is the first item that formed the cluster of x
+    std::vector<size_t> leader(n);
+    std::vector<size_t> cluster_size = instance.item_sizes;
+    std::vector<bool> clustered(n, false);
+    for (size_t x = 0; x < n; x++) {
+        leader[x] = x;
+    }
+    for (const size_t x : order) {
+        const size_t l = leader[partners[x].item];
+        if (clustered[x] ||
+            cluster_size[l] + instance.item_sizes[x] > max_size) {
+            continue;
+        }
+        leader[x] = l;
+        cluster_size[l] += instance.item_sizes[x];
+        clustered[x] = clustered[partners[x].item] = true;
+    }
+
+    constexpr size_t UNASSIGNED = std::numeric_limits<size_t>::max();
+    std::vector<size_t> cluster(n, UNASSIGNED);
+    size_t n_clusters = 0;
+    for (size_t x = 0; x < n; x++) {
+        if (cluster[leader[x]] == UNASSIGNED) {
+            cluster[leader[x]] = n_clusters++;
+        }
+        cluster[x] = cluster[leader[x]];
+    }
+    return {cluster, n_clusters};
+}
+
+} // namespace
+
+PartitionSoln
+optift::partition_solve_multilevel(const PartitionInstance &instance,
+                                   const InitialSolver &initial_solver,
+                                   const SolveControl &control) {
+    const size_t total_size =
+        ranges::accumulate(instance.item_sizes, size_t(0));
+    const size_t max_size = std::max<size_t>(
+        1, static_cast<size_t>(ML_MAX_CLUSTER_SHARE *
+                               static_cast<double>(total_size) /
+                               static_cast<double>(instance.n_partitions)));
+    const size_t coarsest_items =
+        ML_COARSEST_ITEMS_PER_PARTITION * instance.n_partitions;
+
+    // levels[l] is obtained by clustering the items of levels[l - 1], or of
+    // the input instance for l = 0
+    std::vector<CoarsenedInstance> levels;
+    const auto level_instance = [&](size_t l) -> const PartitionInstance & {
+        return l == 0 ? instance : levels[l - 1].instance;
+    };
+    while (level_instance(levels.size()).n_items > coarsest_items) {
+        const PartitionInstance &fine = level_instance(levels.size());
+        auto [item_map, n_items] = cluster_items(fine, max_size);
+        if (static_cast<double>(n_items) >
+            static_cast<double>(fine.n_items) * (1.0 - ML_MIN_SHRINK)) {
+            break;
+        }
+        levels.push_back(contract_instance(fine, std::move(item_map), n_items));
+        spdlog::debug("multilevel: level {} has {} items, {} requests",
+                      levels.size(), n_items,
+                      levels.back().instance.n_requests());
+    }
+
+    // Solutions of coarse levels are not checkpointed, they would have to be
+    // projected all the way back first
+    SolveControl coarse_control = control;
+    coarse_control.checkpoint = nullptr;
+    const auto level_control = [&](size_t l) -> const SolveControl & {
+        return l == 0 ? control : coarse_control;
+    };
+
+    const PartitionInstance &coarsest = level_instance(levels.size());
+    PartitionSoln soln =
+        partition_refine_fm(coarsest, initial_solver(coarsest),
+                            level_control(levels.size()));
+    spdlog::info("multilevel: coarsest level ({} items) cost {}",
+                 coarsest.n_items, coarsest.eval(soln));
+
+    for (size_t l = levels.size(); l > 0; l--) {
+        soln = partition_refine_fm(level_instance(l - 1),
+                                   levels[l - 1].project(soln),
+                                   level_control(l - 1));
+        spdlog::debug("multilevel: level {} refined cost {}", l - 1,
+                      level_instance(l - 1).eval(soln));
+    }
+    return soln;
+}
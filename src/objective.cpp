@@ -0,0 +1,135 @@
+#include "partitioner.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include <range/v3/algorithm/stable_sort.hpp>
+#include <range/v3/numeric/accumulate.hpp>
+#include <range/v3/range/conversion.hpp>
+#include <range/v3/view/iota.hpp>
+
+using namespace optift;
+
+// Requests outside the tail keep this fraction of their weight when the tail
+// objective is linearized, so that moves which only affect them are not free
+// and the solvers do not make them arbitrarily expensive
+constexpr double OBJECTIVE_TAIL_MEAN_WEIGHT = 0.01;
+// Rounds that make the objective worse halve the step towards the linearized
+// weights from the request weights, down to this step
+constexpr double OBJECTIVE_MIN_STEP = 1.0 / 16;
+
+namespace {
+
+/**
+ * Returns the share of the weight of each request that falls in the most
+ * expensive fraction of the total weight. Shares are 1 in the tail, 0 outside
+ * it, and in between for the request at the boundary. Requests of equal cost
+ * enter the tail by index.
+ */
+std::vector<double> tail_shares(const std::vector<double> &costs,
+                                const std::vector<double> &weights,
+                                double fraction) {
+    std::vector<size_t> order =
+        ranges::views::iota(size_t(0), costs.size()) |
+        ranges::to<std::vector>();
+    ranges::stable_sort(order, std::greater<>{},
+                        [&](size_t u) { return costs[u]; });
+    std::vector<double> shares(costs.size(), 0.0);
+    double remaining = fraction * ranges::accumulate(weights, 0.0);
+    for (const size_t u : order) {
+        if (remaining <= 0.0) {
+            break;
+        }
+        if (weights[u] > 0.0) {
+            shares[u] = std::min(1.0, remaining / weights[u]);
+            remaining -= weights[u];
+        }
+    }
+    return shares;
+}
+
+} // namespace
+
+double PartitionInstance::eval_objective(const PartitionSoln &soln) const {
+    if (objective.kind == Objective::Kind::Mean) {
+        return eval(soln);
+    }
+    const std::vector<double> costs = request_costs(soln);
+    double total = 0.0;
+    if (objective.kind == Objective::Kind::Capped) {
+        for (size_t u = 0; u < n_requests(); u++) {
+            total += weights[u] *
+                     (costs[u] + objective.penalty *
+                                     std::max(0.0, costs[u] - objective.cap));
+        }
+    } else {
+        const std::vector<double> shares =
+            tail_shares(costs, weights, objective.tail_fraction);
+        for (size_t u = 0; u < n_requests(); u++) {
+            total += weights[u] * shares[u] * costs[u];
+        }
+        total /= objective.tail_fraction;
+    }
+    return total + eval_changes(soln);
+}
+
+std::vector<double>
+PartitionInstance::objective_weights(const PartitionSoln &soln) const {
+    if (objective.kind == Objective::Kind::Mean) {
+        return weights;
+    }
+    const std::vector<double> costs = request_costs(soln);
+    std::vector<double> result(n_requests());
+    if (objective.kind == Objective::Kind::Capped) {
+        for (size_t u = 0; u < n_requests(); u++) {
+            result[u] =
+                weights[u] * (costs[u] > objective.cap
+                                  ? 1.0 + objective.penalty
+                                  : 1.0);
+        }
+    } else {
+        const std::vector<double> shares =
+            tail_shares(costs, weights, objective.tail_fraction);
+        for (size_t u = 0; u < n_requests(); u++) {
+            result[u] = weights[u] * (OBJECTIVE_TAIL_MEAN_WEIGHT +
+                                      shares[u] / objective.tail_fraction);
+        }
+    }
+    return result;
+}
+
+PartitionSoln optift::partition_solve_objective(
+    const PartitionInstance &instance, PartitionSoln soln,
+    const std::function<PartitionSoln(const PartitionInstance &,
+                                      PartitionSoln)> &solve,
+    const SolveControl &control, size_t max_rounds) {
+    double cost = instance.eval_objective(soln);
+    PartitionInstance linearized = instance;
+    double step = 1.0;
+    for (size_t round = 0; round < max_rounds &&
+                           step >= OBJECTIVE_MIN_STEP && !control.should_stop();
+         round++) {
+        const std::vector<double> weights = instance.objective_weights(soln);
+        for (size_t u = 0; u < instance.n_requests(); u++) {
+            linearized.weights[u] = (1.0 - step) * instance.weights[u] +
+                                    step * weights[u];
+        }
+        PartitionSoln next = solve(linearized, soln);
+        const double next_cost = instance.eval_objective(next);
+        spdlog::info("objective round {} (step {}): {} -> {}", round, step,
+                     cost, next_cost);
+        if (next_cost < cost) {
+            soln = std::move(next);
+            cost = next_cost;
+        } else {
+            // The linearization was trusted too far, e.g. requests outside
+            // the tail became more expensive than the tail itself
+            step /= 2;
+        }
+    }
+    return soln;
+}
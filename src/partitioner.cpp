@@ -1,324 +1,1154 @@
 #include "partitioner.h"
 
-#include <bit>
+#include <algorithm>
 #include <cstdint>
-#include <optional>
+#include <limits>
+#include <queue>
+#include <span>
 #include <stdexcept>
-#include <unordered_map>
 #include <unordered_set>
+#include <tuple>
 #include <utility>
 
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
+#include <range/v3/algorithm/any_of.hpp>
+#include <range/v3/algorithm/contains.hpp>
+#include <range/v3/algorithm/max.hpp>
+#include <range/v3/algorithm/min.hpp>
+#include <range/v3/algorithm/min_element.hpp>
 #include <range/v3/algorithm/sort.hpp>
+#include <range/v3/algorithm/stable_sort.hpp>
 #include <range/v3/numeric/accumulate.hpp>
 #include <range/v3/range/conversion.hpp>
-#include <range/v3/view/enumerate.hpp>
+#include <range/v3/view/iota.hpp>
+#include <range/v3/view/reverse.hpp>
 #include <range/v3/view/transform.hpp>
 
+#include "dynamic_bitset.h"
+#include "item_move_state.h"
+#include "item_set.h"
+
 using namespace optift;
 
-double PartitionInstance::eval(const PartitionSoln &soln) const {
-    const std::vector<std::unordered_set<size_t>> &partitions = soln.partitions;
+// Maximum number of passes of the FM refinement
+constexpr size_t FM_MAX_PASSES = 16;
+// An FM pass stops after this many moves without improving on the best prefix
+constexpr size_t FM_MAX_UPHILL_MOVES = 64;
 
-    if (partitions.size() != n_partitions) {
-        throw std::runtime_error(
-            fmt::format("invalid number of partitions: expected {}, got {}",
-                        n_partitions, partitions.size()));
+void CsrMatrix::push_row(std::vector<size_t> columns) {
+    ranges::sort(columns);
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+    indices.insert(indices.end(), columns.begin(), columns.end());
+    offsets.push_back(indices.size());
+}
+
+CsrMatrix CsrMatrix::transpose(size_t n_cols) const {
+    CsrMatrix result;
+    transpose_into(n_cols, result);
+    return result;
+}
+
+void CsrMatrix::transpose_into(size_t n_cols, CsrMatrix &result) const {
+    result.offsets.assign(n_cols + 1, 0);
+    result.indices.resize(indices.size());
+    for (const size_t col : indices) {
+        result.offsets[col + 1]++;
     }
+    for (size_t col = 0; col < n_cols; col++) {
+        result.offsets[col + 1] += result.offsets[col];
+    }
+    // Rows are visited in order, so the columns of the result come out sorted.
+    // offsets[col] serves as the next position of column col, which leaves it
+    // at the start of column col + 1.
+    for (size_t i = 0; i < n_rows(); i++) {
+        for (const size_t col : row(i)) {
+            result.indices[result.offsets[col]++] = i;
+        }
+    }
+    std::shift_right(result.offsets.begin(), result.offsets.end(), 1);
+    result.offsets[0] = 0;
+}
 
-    for (const auto &partition : partitions) {
-        for (size_t i : partition) {
-            if (i >= n_items) {
+CssCost
+CssCost::from_pairs(size_t n_items,
+                    std::span<const std::pair<size_t, size_t>> pairs,
+                    size_t base_runs, double bytes_per_run) {
+    CssCost result{.bytes_per_run = bytes_per_run, .neighbors = {},
+                   .base_runs = base_runs};
+    // Counting sort of both directions of every pair by their first item
+    std::vector<size_t> &offsets = result.neighbors.offsets;
+    offsets.assign(n_items + 1, 0);
+    for (const auto &[x, y] : pairs) {
+        if (x == y) {
+            result.base_runs--;
+        } else {
+            offsets[x + 1]++;
+            offsets[y + 1]++;
+        }
+    }
+    for (size_t x = 0; x < n_items; x++) {
+        offsets[x + 1] += offsets[x];
+    }
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    result.neighbors.indices.resize(offsets.back());
+    for (const auto &[x, y] : pairs) {
+        if (x != y) {
+            result.neighbors.indices[next[x]++] = y;
+            result.neighbors.indices[next[y]++] = x;
+        }
+    }
+    return result;
+}
+
+PartitionSoln PartitionSoln::from_partitions(
+    const std::vector<std::unordered_set<size_t>> &partitions,
+    size_t n_items) {
+    constexpr size_t UNASSIGNED = std::numeric_limits<size_t>::max();
+    PartitionSoln soln{
+        .n_partitions = partitions.size(),
+        .item_to_partition = std::vector<size_t>(n_items, UNASSIGNED),
+    };
+    for (size_t k = 0; k < partitions.size(); k++) {
+        for (const size_t item : partitions[k]) {
+            if (item >= n_items) {
                 throw std::runtime_error("invalid item index");
             }
+            if (soln.item_to_partition[item] != UNASSIGNED) {
+                throw std::runtime_error(fmt::format(
+                    "item {} is assigned to more than one partition", item));
+            }
+            soln.item_to_partition[item] = k;
         }
     }
+    if (ranges::contains(soln.item_to_partition, UNASSIGNED)) {
+        throw std::runtime_error("not all items are assigned a partition");
+    }
+    return soln;
+}
 
-    std::unordered_map<size_t, size_t> item_to_partition;
-    for (size_t i = 0; i < partitions.size(); i++) {
-        for (size_t item : partitions[i]) {
-            item_to_partition[item] = i;
-        }
+std::vector<std::vector<size_t>> PartitionSoln::partitions() const {
+    std::vector<std::vector<size_t>> result(n_partitions);
+    for (size_t item = 0; item < item_to_partition.size(); item++) {
+        result[item_to_partition[item]].push_back(item);
     }
-    if (item_to_partition.size() != n_items) {
+    return result;
+}
+
+PartitionInstance PartitionInstance::from_csr(size_t n_partitions,
+                                              size_t n_items,
+                                              std::vector<double> weights,
+                                              CsrMatrix request_items,
+                                              CostModel cost_model) {
+    if (weights.size() != request_items.n_rows()) {
+        throw std::runtime_error(
+            fmt::format("invalid number of weights: expected {}, got {}",
+                        request_items.n_rows(), weights.size()));
+    }
+    if (ranges::any_of(request_items.indices,
+                       [&](size_t item) { return item >= n_items; })) {
+        throw std::runtime_error("invalid item index");
+    }
+    CsrMatrix item_requests = request_items.transpose(n_items);
+    return {
+        .n_partitions = n_partitions,
+        .n_items = n_items,
+        .item_sizes = std::vector<size_t>(n_items, 1),
+        .weights = std::move(weights),
+        .request_items = std::move(request_items),
+        .item_requests = std::move(item_requests),
+        .cost_model = std::move(cost_model),
+        .objective = {},
+        .min_partition_size = 0,
+        .max_partition_size = std::numeric_limits<size_t>::max(),
+        .css_cost = {},
+        .change_cost = {},
+    };
+}
+
+PartitionInstance PartitionInstance::from_requests(
+    size_t n_partitions, size_t n_items,
+    const std::vector<std::pair<double, std::unordered_set<size_t>>> &requests,
+    CostModel cost_model) {
+    std::vector<double> weights;
+    CsrMatrix request_items;
+    for (const auto &[weight, items] : requests) {
+        weights.push_back(weight);
+        request_items.push_row({items.begin(), items.end()});
+    }
+    return from_csr(n_partitions, n_items, std::move(weights),
+                    std::move(request_items), std::move(cost_model));
+}
+
+namespace {
+
+/// Checks that soln assigns every item of the instance to one of n_partitions
+/// partitions.
+void check_assignment(const PartitionInstance &instance,
+                      const PartitionSoln &soln, size_t n_partitions) {
+    const std::vector<size_t> &item_to_partition = soln.item_to_partition;
+    if (item_to_partition.size() != instance.n_items) {
         throw std::runtime_error(
             fmt::format("invalid number of covered items: expected {}, got {}",
-                        n_items, item_to_partition.size()));
+                        instance.n_items, item_to_partition.size()));
+    }
+    if (ranges::any_of(item_to_partition,
+                       [&](size_t k) { return k >= n_partitions; })) {
+        throw std::runtime_error("invalid partition index");
     }
+}
 
-    // std::vector<double> partition_costs;
-    // partition_costs.reserve(partitions.size());
-    // for (const auto &partition : partitions) {
-    //     const auto size = static_cast<double>(partition.size());
-    //     partition_costs.push_back(cost_model(size));
-    // }
+/**
+ * Computes, in parallel, the cost of every request and the number of
+ * partitions it uses.
+ *
+ * \param partition_costs The cost of each partition
+ * \param costs Output, the cost of each request
+ * \param counts Output, the number of partitions used by each request
+ */
+void eval_requests(const PartitionInstance &instance,
+                   std::span<const size_t> item_to_partition,
+                   std::span<const double> partition_costs,
+                   std::span<double> costs, std::span<size_t> counts) {
+    // seen[k] is one plus the last request found to use partition k, so the
+    // buffer never needs to be cleared
+    tbb::enumerable_thread_specific<std::vector<size_t>> scratch{
+        [&] { return std::vector<size_t>(partition_costs.size(), 0); }};
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>{0, instance.n_requests()},
+        [&](const tbb::blocked_range<size_t> &range) {
+            auto &seen = scratch.local();
+            for (size_t u = range.begin(); u < range.end(); u++) {
+                double cost = 0.0;
+                size_t count = 0;
+                for (const size_t x : instance.request_items.row(u)) {
+                    const size_t k = item_to_partition[x];
+                    if (seen[k] != u + 1) {
+                        seen[k] = u + 1;
+                        cost += partition_costs[k];
+                        count++;
+                    }
+                }
+                costs[u] = cost;
+                counts[u] = count;
+            }
+        });
+}
 
-    using namespace ranges;
+/// Summarizes values[u] weighted by weights[u].
+template <typename T>
+WeightedSummary summarize(std::span<const T> values,
+                          std::span<const double> weights) {
+    WeightedSummary summary;
+    const double total_weight = ranges::accumulate(weights, 0.0);
+    if (values.empty() || total_weight <= 0.0) {
+        return summary;
+    }
+    std::vector<size_t> order =
+        ranges::views::iota(size_t(0), values.size()) |
+        ranges::to<std::vector>();
+    ranges::stable_sort(order, std::less<>{},
+                        [&](size_t u) { return values[u]; });
 
-    const auto map = [](auto &mapping) {
-        return views::transform([&mapping](auto i) { return mapping[i]; });
+    for (size_t u = 0; u < values.size(); u++) {
+        summary.mean += weights[u] * static_cast<double>(values[u]);
+    }
+    summary.mean /= total_weight;
+    summary.max = static_cast<double>(values[order.back()]);
+    // Smallest value such that requests up to it carry at least q of the
+    // total weight
+    const auto quantile = [&](double q) {
+        double cumulative = 0.0;
+        for (const size_t u : order) {
+            cumulative += weights[u];
+            if (cumulative >= q * total_weight) {
+                return static_cast<double>(values[u]);
+            }
+        }
+        return summary.max;
     };
+    summary.p50 = quantile(0.50); // NOLINT(*-magic-numbers)
+    summary.p95 = quantile(0.95); // NOLINT(*-magic-numbers)
+    summary.p99 = quantile(0.99); // NOLINT(*-magic-numbers)
+    return summary;
+}
 
+} // namespace
+
+std::vector<double>
+PartitionInstance::request_costs(const PartitionSoln &soln) const {
+    if (soln.n_partitions != n_partitions) {
+        throw std::runtime_error(
+            fmt::format("invalid number of partitions: expected {}, got {}",
+                        n_partitions, soln.n_partitions));
+    }
+    check_assignment(*this, soln, n_partitions);
+
+    std::vector<size_t> partition_sizes(n_partitions, 0);
+    for (size_t x = 0; x < n_items; x++) {
+        partition_sizes[soln.item_to_partition[x]] += item_sizes[x];
+    }
     const std::vector<double> partition_costs =
-        partitions |
-        views::transform([&](const auto &p) { return cost_model(p.size()); }) |
-        to<std::vector>;
-
-    return accumulate(
-        requests | views::transform([&](const auto &req) {
-            const auto &[weight, items] = req;
-            const std::unordered_set<size_t> partitions =
-                items | map(item_to_partition) | to<std::unordered_set>;
-            return weight * accumulate(partitions | map(partition_costs), 0.0);
-        }),
-        0.0);
+        partition_sizes | ranges::views::transform([&](size_t size) {
+            return cost_model(size);
+        }) |
+        ranges::to<std::vector>;
+
+    std::vector<double> costs(n_requests());
+    std::vector<size_t> counts(n_requests());
+    eval_requests(*this, soln.item_to_partition, partition_costs, costs,
+                  counts);
+    if (has_css_cost()) {
+        const double css =
+            css_cost.bytes_per_run *
+            static_cast<double>(css_runs(soln.item_to_partition));
+        for (double &cost : costs) {
+            cost += css;
+        }
+    }
+    return costs;
 }
 
-PartitionSoln
-optift::partition_solve_baseline(const PartitionInstance &instance) {
-    std::vector<std::unordered_set<size_t>> partitions(instance.n_partitions);
-    for (size_t i = 0; i < instance.n_items; i++)
-        partitions[0].insert(i);
-    return {partitions};
+size_t PartitionInstance::css_runs(
+    std::span<const size_t> item_to_partition) const {
+    // Every pair within a partition is seen from both of its items
+    size_t joined = 0;
+    for (size_t x = 0; x < css_cost.neighbors.n_rows(); x++) {
+        for (const size_t y : css_cost.neighbors.row(x)) {
+            joined += item_to_partition[x] == item_to_partition[y] ? 1 : 0;
+        }
+    }
+    return css_cost.base_runs - joined / 2;
 }
 
-struct DynamicBitSet {
-    using Element = uint64_t;
-    constexpr static size_t ElementBits = sizeof(Element) * 8;
+double PartitionInstance::css_run_weight() const {
+    return css_cost.bytes_per_run * ranges::accumulate(weights, 0.0);
+}
 
-    size_t n_items;
-    std::vector<Element> bits;
+double PartitionInstance::eval(const PartitionSoln &soln) const {
+    const std::vector<double> costs = request_costs(soln);
+    // Summed serially so that the result does not depend on scheduling
+    double total = 0.0;
+    for (size_t u = 0; u < n_requests(); u++) {
+        total += weights[u] * costs[u];
+    }
+    return total + eval_changes(soln);
+}
 
-    explicit DynamicBitSet(size_t n)
-        : bits((n + ElementBits - 1) / ElementBits, 0), n_items{n} {}
+EvalReport
+PartitionInstance::eval_report(const PartitionSoln &soln,
+                               std::span<const double> partition_costs) const {
+    check_assignment(*this, soln, partition_costs.size());
 
-    template <std::ranges::input_range Container>
-    explicit DynamicBitSet(size_t n, const Container &c) : DynamicBitSet{n} {
-        for (size_t i : c) {
-            set(i);
-        }
+    std::vector<double> costs(n_requests());
+    std::vector<size_t> counts(n_requests());
+    eval_requests(*this, soln.item_to_partition, partition_costs, costs,
+                  counts);
+    EvalReport report;
+    for (size_t u = 0; u < n_requests(); u++) {
+        report.total += weights[u] * costs[u];
     }
+    report.cost = summarize<double>(costs, weights);
+    report.partitions = summarize<size_t>(counts, weights);
+    return report;
+}
 
-    size_t size() const {
-        size_t count = 0;
-        for (uint64_t word : bits) {
-            count += std::popcount(word);
-        }
-        return count;
+PartitionSoln
+optift::partition_solve_baseline(const PartitionInstance &instance) {
+    // Everything in the first partition
+    return {
+        .n_partitions = instance.n_partitions,
+        .item_to_partition = std::vector<size_t>(instance.n_items, 0),
+    };
+}
+
+/// Relabels partitions so that larger partitions come first, unless they are
+/// matched with those of a previous solution.
+static void sort_partitions_by_size(const PartitionInstance &instance,
+                                    PartitionSoln &soln) {
+    if (instance.has_change_cost()) {
+        return;
     }
+    std::vector<size_t> sizes(soln.n_partitions, 0);
+    for (size_t x = 0; x < soln.item_to_partition.size(); x++) {
+        sizes[soln.item_to_partition[x]] += instance.item_sizes[x];
+    }
+    std::vector<size_t> order = ranges::views::iota(size_t(0), sizes.size()) |
+                                ranges::to<std::vector>();
+    ranges::stable_sort(order, std::greater<>{},
+                        [&](size_t k) { return sizes[k]; });
+    std::vector<size_t> relabel(sizes.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        relabel[order[k]] = k;
+    }
+    for (size_t &k : soln.item_to_partition) {
+        k = relabel[k];
+    }
+}
 
-    void set(size_t i) { bits[i / ElementBits] |= 1ULL << (i % ElementBits); }
+struct HeuristicPartition {
+    ItemSet items;
+    // Cached total size of items
+    size_t size;
+    // Cached total weight of requests that overlap with this partition
+    double reqs_weight;
+};
 
-    /// Returns a pair of bitsets, the first is the difference, the second is
-    /// the intersection with the other bitset.
-    std::pair<DynamicBitSet, DynamicBitSet>
-    diff_intersect_with(const DynamicBitSet &other) const {
-        // Can make do if sizes are different, but not doing that for now.
-        assert_same_size(other);
+/// A candidate move of the heuristic solver, ordered by (cost, i, j).
+struct HeuristicMove {
+    constexpr static size_t NONE = std::numeric_limits<size_t>::max();
 
-        DynamicBitSet diff{n_items};
-        DynamicBitSet inter{n_items};
-        for (size_t i = 0; i < bits.size(); i++) {
-            diff.bits[i] = bits[i] & ~other.bits[i];
-            inter.bits[i] = bits[i] & other.bits[i];
+    double cost;
+    size_t i = NONE; // Source partition
+    size_t j = NONE; // Target partition
+
+    auto operator<=>(const HeuristicMove &) const = default;
+};
+
+/// Per-thread scratch buffers of the heuristic solver, so that evaluating a
+/// move does not allocate.
+struct HeuristicScratch {
+    ItemSet items;
+    // See HeuristicState::count_reqs
+    std::vector<size_t> counts;
+    std::vector<size_t> touched;
+    // adjacent[k] is the number of pairs of consecutive codepoints between
+    // the moved items and the other items of partition k
+    std::vector<size_t> adjacent;
+    // previous[k] is the number of moved items that were in partition k of
+    // the previous solution
+    std::vector<size_t> previous;
+};
+
+/**
+ * Incremental state of the heuristic solver. Besides the partitions themselves,
+ * we keep track of how many items of each request fall into each partition, so
+ * that the gain of a move can be computed by only looking at the items moved.
+ *
+ * \tparam Cost The type of the cost model, see \ref visit_cost_model
+ */
+template <typename Cost> struct HeuristicState {
+    const PartitionInstance &instance;
+    const Cost &cost;
+    std::vector<std::pair<double, ItemSet>> r;
+    std::vector<HeuristicPartition> p;
+    // overlap[u * p.size() + k] is the number of items request u has in
+    // partition k
+    std::vector<size_t> overlap;
+    // Partition of each item, for the CSS cost
+    std::vector<size_t> part;
+    // See PartitionInstance::css_run_weight
+    double css_weight;
+    // See PartitionInstance::change_mismatches
+    std::vector<size_t> mismatches;
+
+    HeuristicState(const PartitionInstance &instance,
+                   const PartitionSoln &initial_soln, const Cost &cost)
+        : instance{instance}, cost{cost},
+          part{initial_soln.item_to_partition},
+          css_weight{instance.css_run_weight()},
+          mismatches{instance.change_mismatches(
+              initial_soln.item_to_partition, initial_soln.n_partitions)} {
+        for (size_t u = 0; u < instance.n_requests(); u++) {
+            r.emplace_back(instance.weights[u],
+                           ItemSet{instance.n_items,
+                                   instance.request_items.row(u)});
         }
-        return {diff, inter};
-    }
 
-    DynamicBitSet union_with(const DynamicBitSet &other) const {
-        assert_same_size(other);
-        DynamicBitSet result{n_items};
-        for (size_t i = 0; i < bits.size(); i++) {
-            result.bits[i] = bits[i] | other.bits[i];
+        const size_t n_parts = initial_soln.n_partitions;
+        const auto &item_to_partition = initial_soln.item_to_partition;
+        std::vector<std::vector<size_t>> part_items(n_parts);
+        std::vector<size_t> part_sizes(n_parts, 0);
+        for (size_t item = 0; item < instance.n_items; item++) {
+            part_items[item_to_partition[item]].push_back(item);
+            part_sizes[item_to_partition[item]] += instance.item_sizes[item];
+        }
+        for (size_t k = 0; k < n_parts; k++) {
+            p.push_back({
+                .items = ItemSet{instance.n_items, part_items[k]},
+                .size = part_sizes[k],
+                .reqs_weight = 0.0,
+            });
         }
-        return result;
-    }
 
-    bool is_disjoint(const DynamicBitSet &other) const {
-        assert_same_size(other);
-        for (size_t i = 0; i < bits.size(); i++) {
-            if (bits[i] & other.bits[i]) {
-                return false;
+        overlap.assign(r.size() * n_parts, 0);
+        for (size_t u = 0; u < r.size(); u++) {
+            for (const size_t item : instance.request_items.row(u)) {
+                const size_t k = item_to_partition[item];
+                if (overlap[u * n_parts + k]++ == 0) {
+                    p[k].reqs_weight += r[u].first;
+                }
             }
         }
-        return true;
     }
 
-    std::unordered_set<size_t> to_set() const {
-        std::unordered_set<size_t> result;
-        for (size_t i = 0; i < bits.size(); i++) {
-            for (Element t = bits[i]; t; t &= t - 1) {
-                const size_t tz = std::countr_zero(t);
-                result.insert(i * ElementBits + tz);
+    /**
+     * Counts, for every request, how many of the given items it contains.
+     *
+     * \param items The set of items
+     * \param counts Scratch buffer of size r.size(), must be all zeros. Only
+     *   entries listed in touched are modified.
+     * \param touched Output list of requests with non-zero counts
+     * \return The total size of the items
+     */
+    size_t count_reqs(const ItemSet &items, std::vector<size_t> &counts,
+                      std::vector<size_t> &touched) const {
+        touched.clear();
+        size_t size = 0;
+        items.for_each([&](size_t item) {
+            size += instance.item_sizes[item];
+            for (const size_t u : instance.item_requests.row(item)) {
+                if (counts[u]++ == 0) {
+                    touched.push_back(u);
+                }
             }
-        }
-        return result;
+        });
+        return size;
     }
 
-  private:
-    void assert_same_size(const DynamicBitSet &other) const {
-        if (n_items != other.n_items) {
-            throw std::runtime_error{
-                fmt::format("bitsets have different sizes: {} and {}", n_items,
-                            other.n_items)};
+    /**
+     * Finds the best move of the items of a request in partition i to another
+     * partition. This only reads the state, so it is safe to call
+     * concurrently with distinct scratch buffers.
+     *
+     * \param i The source partition
+     * \param items The items of the request
+     * \param cur_cost The cost of the current solution
+     * \param scratch Scratch buffers, see \ref HeuristicScratch
+     * \return The best move that has a cost below cur_cost, if any
+     */
+    HeuristicMove best_move_from(size_t i, const ItemSet &items,
+                                 double cur_cost,
+                                 HeuristicScratch &scratch) const {
+        const size_t n_parts = p.size();
+        HeuristicMove best{.cost = cur_cost};
+
+        auto &[items_removed, counts, touched, adjacent, previous] = scratch;
+        const HeuristicPartition &p1 = p[i];
+        if (p1.items.intersect_into(items, items_removed) == 0) {
+            // Nothing to move
+            return best;
+        }
+        if (css_weight > 0.0) {
+            std::ranges::fill(adjacent, 0);
+            items_removed.for_each([&](size_t x) {
+                for (const size_t y : instance.css_cost.neighbors.row(x)) {
+                    if (!items_removed.test(y)) {
+                        adjacent[part[y]]++;
+                    }
+                }
+            });
+        }
+        if (instance.has_change_cost()) {
+            std::ranges::fill(previous, 0);
+            items_removed.for_each([&](size_t x) {
+                if (const size_t k = instance.change_cost.previous[x];
+                    k != ChangeCost::NEW) {
+                    previous[k]++;
+                }
+            });
+        }
+        // A request stops using p1 if all its items in p1 are removed
+        const size_t n_removed = count_reqs(items_removed, counts, touched);
+        double reqs_removed_weight = 0.0;
+        for (const auto u : touched) {
+            if (overlap[u * n_parts + i] == counts[u]) {
+                reqs_removed_weight += r[u].first;
+            }
         }
-    }
-};
 
-struct HeuristicPartition {
-    std::unordered_set<size_t> reqs;
-    DynamicBitSet items;
-};
+        const size_t size_before = p1.size;
+        const size_t size_after = size_before - n_removed;
+        const double cost_after_ban =
+            cur_cost +
+            (p1.reqs_weight * cost_difference(cost, size_before, size_after)) -
+            (reqs_removed_weight * cost(size_after));
 
-PartitionSoln
-optift::partition_solve_heuristic(const PartitionInstance &instance,
-                                  PartitionSoln initial_soln) {
+        // Try to move items_removed to another partition j
+        for (size_t j = 0; j < n_parts; j++) {
+            if (i == j) {
+                // Cannot move to the same partition
+                continue;
+            }
+            const HeuristicPartition &p2 = p[j];
+            if (!instance.allows_move(p1.size, p2.size, n_removed)) {
+                continue;
+            }
+            const size_t size_before = p2.size;
+            const size_t size_after = size_before + n_removed;
+            // Requests that start using p2 after the move
+            double reqs_extended_weight = 0.0;
+            for (const auto u : touched) {
+                if (overlap[u * n_parts + j] == 0) {
+                    reqs_extended_weight += r[u].first;
+                }
+            }
+            // The moved items leave runs in p1 and join runs in p2
+            const double css_delta =
+                css_weight > 0.0
+                    ? css_weight * (static_cast<double>(adjacent[i]) -
+                                    static_cast<double>(adjacent[j]))
+                    : 0.0;
+            const double change_delta =
+                instance.has_change_cost()
+                    ? instance.change_cost_delta(mismatches, i, j,
+                                                 items_removed.size(),
+                                                 previous[i], previous[j])
+                    : 0.0;
+            const double cost_after_add =
+                cost_after_ban +
+                (cost_difference(cost, size_before, size_after) *
+                 p2.reqs_weight) +
+                (cost(size_after) * reqs_extended_weight) + css_delta +
+                change_delta;
+            if (cost_after_add < best.cost) {
+                best = {.cost = cost_after_add, .i = i, .j = j};
+            }
+        }
+        for (const auto u : touched) {
+            counts[u] = 0;
+        }
+        return best;
+    }
 
-    const std::vector<std::pair<double, DynamicBitSet>> r =
-        instance.requests | ranges::views::transform([&](const auto &req) {
-            const auto &[w, items] = req;
-            DynamicBitSet set{instance.n_items, items};
-            return std::pair{w, set};
-        }) |
-        ranges::to<std::vector>();
+    /// Returns the current solution.
+    PartitionSoln soln() const {
+        PartitionSoln soln{
+            .n_partitions = p.size(),
+            .item_to_partition = std::vector<size_t>(instance.n_items),
+        };
+        for (size_t k = 0; k < p.size(); k++) {
+            p[k].items.for_each(
+                [&](size_t item) { soln.item_to_partition[item] = k; });
+        }
+        return soln;
+    }
 
-    std::unordered_map<size_t, std::unordered_set<size_t>> item_to_reqs;
-    for (const auto &[i, w_items] :
-         instance.requests | ranges::views::enumerate) {
-        const auto &[_, items] = w_items;
-        for (size_t item : items) {
-            if (const auto it = item_to_reqs.find(item);
-                it != item_to_reqs.end()) {
-                it->second.insert(i);
-            } else {
-                item_to_reqs[item] = {i};
+    /// Moves the items of a request in partition i to partition j.
+    void apply_move(size_t i, size_t j, const ItemSet &items,
+                    HeuristicScratch &scratch) {
+        auto &[items_moved, counts, touched, _, __] = scratch;
+        const size_t n_parts = p.size();
+        p[i].items.intersect_into(items, items_moved);
+        items_moved.for_each([&](size_t x) {
+            part[x] = j;
+            if (instance.has_change_cost()) {
+                // See PartitionInstance::change_mismatches
+                const size_t k = instance.change_cost.previous[x];
+                mismatches[i] = k == i ? mismatches[i] + 1 : mismatches[i] - 1;
+                mismatches[j] = k == j ? mismatches[j] - 1 : mismatches[j] + 1;
+            }
+        });
+        p[i].items.subtract(items_moved);
+        p[j].items.unite(items_moved);
+        const size_t n_moved = count_reqs(items_moved, counts, touched);
+        p[i].size -= n_moved;
+        p[j].size += n_moved;
+        for (const size_t u : touched) {
+            const double weight = r[u].first;
+            if ((overlap[u * n_parts + i] -= counts[u]) == 0) {
+                p[i].reqs_weight -= weight;
             }
+            if (overlap[u * n_parts + j] == 0) {
+                p[j].reqs_weight += weight;
+            }
+            overlap[u * n_parts + j] += counts[u];
+            counts[u] = 0;
         }
     }
+};
 
-    std::vector<HeuristicPartition> p =
-        initial_soln.partitions |
-        ranges::views::transform([&](const auto &partition) {
-            HeuristicPartition part{
-                .reqs = {},
-                .items = DynamicBitSet{instance.n_items},
-            };
-            for (const auto item : partition) {
-                const auto &reqs = item_to_reqs.at(item);
-                part.reqs.insert(reqs.begin(), reqs.end());
-                part.items.set(item);
-            }
-            return part;
-        }) |
-        ranges::to<std::vector>();
+/// The heuristic solver for a cost model of type Cost, see
+/// \ref partition_solve_heuristic.
+template <typename Cost>
+PartitionSoln solve_heuristic(const PartitionInstance &instance,
+                              const PartitionSoln &initial_soln,
+                              const SolveControl &control, const Cost &cost) {
+    spdlog::debug("using {} bitset kernels",
+                  bitset_kernels::implementation());
+    HeuristicState state{instance, initial_soln, cost};
+    const auto &r = state.r;
+    auto &p = state.p;
+    const size_t n_parts = p.size();
+
+    tbb::enumerable_thread_specific<HeuristicScratch> scratch{[&] {
+        return HeuristicScratch{
+            .items = ItemSet{instance.n_items},
+            .counts = std::vector<size_t>(r.size(), 0),
+            .touched = {},
+            .adjacent = std::vector<size_t>(n_parts, 0),
+            .previous = std::vector<size_t>(
+                std::max(n_parts, instance.change_cost.partition_costs.size()),
+                0),
+        };
+    }};
 
     double cur_cost = instance.eval(initial_soln);
-    const auto &cost = instance.cost_model;
     bool can_improve = true;
-    for (int iter = 0; can_improve; iter++) {
+    bool stopped = false;
+    size_t iter = 0;
+    for (; can_improve && !stopped; iter++) {
+        if (control.max_iterations > 0 && iter >= control.max_iterations) {
+            stopped = true;
+            break;
+        }
         can_improve = false;
         for (size_t c = 0; c < r.size(); c++) {
-            double best_cost = cur_cost;
-            std::optional<std::tuple<size_t, HeuristicPartition, size_t,
-                                     HeuristicPartition>>
-                best_move;
+            if (control.should_stop()) {
+                stopped = true;
+                break;
+            }
             const auto &[_, items] = r[c];
-            for (size_t i = 0; i < p.size(); i++) {
-                const HeuristicPartition &p1 = p[i];
-                const auto [items_retained, items_removed] =
-                    p1.items.diff_intersect_with(items);
-                std::unordered_set<size_t> reqs_retained;
-                std::unordered_set<size_t> reqs_affected;
-                double reqs_retained_weight = 0.0;
-                double reqs_removed_weight = 0.0;
-                for (const auto u : p1.reqs) {
-                    const auto &[weight, items_u] = r[u];
-                    if (items_u.is_disjoint(items_retained)) {
-                        reqs_removed_weight += weight;
-                    } else {
-                        reqs_retained_weight += weight;
-                        reqs_retained.insert(u);
+            // Candidate moves are evaluated in parallel over the source
+            // partition. Ties are broken by (i, j) so that the result is the
+            // same as a serial scan regardless of scheduling.
+            const HeuristicMove best = tbb::parallel_reduce(
+                tbb::blocked_range<size_t>{0, n_parts, 1},
+                HeuristicMove{.cost = cur_cost},
+                [&](const tbb::blocked_range<size_t> &range,
+                    HeuristicMove best) {
+                    auto &local = scratch.local();
+                    for (size_t i = range.begin(); i < range.end(); i++) {
+                        best = std::min(best, state.best_move_from(
+                                                  i, items, cur_cost, local));
                     }
-                    if (!items_u.is_disjoint(items_removed)) {
-                        reqs_affected.insert(u);
-                    }
-                }
-
-                const size_t size_before = p1.items.size();
-                const size_t size_after = items_retained.size();
-                const double cost_after_ban =
-                    cur_cost - (reqs_removed_weight * cost(size_before)) -
-                    (reqs_retained_weight *
-                     (cost(size_before) - cost(size_after)));
-
-                // Try to move items_removed to another partition j
-                for (size_t j = 0; j < p.size(); j++) {
-                    if (i == j) {
-                        // Cannot move to the same partition
-                        continue;
-                    }
-                    const HeuristicPartition &p2 = p[j];
-                    const DynamicBitSet items_extended =
-                        p2.items.union_with(items_removed);
-                    const size_t size_before = p2.items.size();
-                    const size_t size_after = items_extended.size();
-                    double reqs_existing_weight = 0.0;
-                    for (const auto u : p2.reqs) {
-                        const auto &[weight, _] = r[u];
-                        reqs_existing_weight += weight;
-                    }
-                    double reqs_extended_weight = 0.0;
-                    for (const auto u : reqs_affected) {
-                        if (!p2.reqs.contains(u)) {
-                            const auto &[weight, _] = r[u];
-                            reqs_extended_weight += weight;
-                        }
-                    }
-                    const double cost_after_add =
-                        cost_after_ban +
-                        ((cost(size_after) - cost(size_before)) *
-                         reqs_existing_weight) +
-                        (cost(size_after) * reqs_extended_weight);
-                    if (cost_after_add < best_cost) {
-                        best_cost = cost_after_add;
-                        std::unordered_set<size_t> new_p2_reqs = p2.reqs;
-                        for (const auto u : reqs_affected) {
-                            new_p2_reqs.insert(u);
-                        }
-                        const HeuristicPartition new_p1{
-                            .reqs = reqs_retained,
-                            .items = items_retained,
-                        };
-                        const HeuristicPartition new_p2{
-                            .reqs = std::move(new_p2_reqs),
-                            .items = items_extended,
-                        };
-                        best_move = {i, new_p1, j, new_p2};
-                    }
-                }
-            }
-            if (best_move.has_value()) {
-                auto [i, new_p1, j, new_p2] = std::move(best_move.value());
+                    return best;
+                },
+                [](const HeuristicMove &a, const HeuristicMove &b) {
+                    return std::min(a, b);
+                });
+            if (best.i != HeuristicMove::NONE) {
+                const auto [best_cost, i, j] = best;
                 can_improve = true;
-                p[i] = std::move(new_p1);
-                p[j] = std::move(new_p2);
+                state.apply_move(i, j, items, scratch.local());
                 spdlog::debug(
                     "iter {:03} cost: {:11.6f} -> {:11.6f} (ban {:02} "
                     "from {:02} and "
                     "join {:02})",
                     iter, cur_cost, best_cost, c, i, j);
                 cur_cost = best_cost;
+                control.maybe_checkpoint([&] { return state.soln(); });
             }
         }
+        spdlog::info("heuristic iteration {}: cost {}", iter, cur_cost);
+        if (control.reached_target(cur_cost)) {
+            stopped = true;
+        }
     }
-    PartitionSoln soln{
-        p | ranges::views::transform([](const auto &part) {
-            return part.items.to_set();
-        }) | ranges::to<std::vector>(),
+    if (stopped) {
+        spdlog::info("heuristic stopped early after {} iterations", iter);
+    }
+    PartitionSoln soln = state.soln();
+    sort_partitions_by_size(instance, soln);
+    return soln;
+}
+
+PartitionSoln
+optift::partition_solve_heuristic(const PartitionInstance &instance,
+                                  PartitionSoln initial_soln,
+                                  const SolveControl &control) {
+    return visit_cost_model(instance, [&](const auto &cost) {
+        return solve_heuristic(instance, initial_soln, control, cost);
+    });
+}
+
+/// FM refinement for a cost model of type Cost, see
+/// \ref partition_refine_fm.
+template <typename Cost>
+PartitionSoln refine_fm(const PartitionInstance &instance, PartitionSoln soln,
+                        const SolveControl &control, const Cost &cost) {
+    ItemMoveState state{instance, soln, cost};
+    const size_t n_items = instance.n_items;
+
+    // Items are prioritized by their best gain (negated delta). Entries are
+    // validated lazily: an entry is dropped if the item changed since it was
+    // pushed, and the gain of the top entry is recomputed before use since
+    // partition sizes and weights change with every move.
+    struct Entry {
+        double gain;
+        size_t item;
+        size_t version;
+
+        bool operator<(const Entry &other) const {
+            return std::tie(gain, other.item) < std::tie(other.gain, item);
+        }
     };
-    ranges::sort(soln.partitions, std::less<>{},
-                 [](const auto &a) { return -static_cast<int>(a.size()); });
+    std::vector<size_t> version(n_items, 0);
+    std::vector<bool> locked(n_items, false);
+    std::priority_queue<Entry> queue;
+    const auto push = [&](size_t x) {
+        if (!locked[x]) {
+            queue.push({-state.best_move(x).first, x, ++version[x]});
+        }
+    };
+
+    double cur_cost = instance.eval(soln);
+    for (size_t pass = 0; pass < FM_MAX_PASSES; pass++) {
+        const double pass_start_cost = cur_cost;
+        locked.assign(n_items, false);
+        queue = {};
+        for (size_t x = 0; x < n_items; x++) {
+            push(x);
+        }
+
+        // Moves made in this pass as (item, source partition)
+        std::vector<std::pair<size_t, size_t>> moves;
+        size_t best_prefix = 0;
+        double best_cost = cur_cost;
+        bool stopped = false;
+        while (!queue.empty() &&
+               moves.size() - best_prefix < FM_MAX_UPHILL_MOVES) {
+            if (control.should_stop()) {
+                stopped = true;
+                break;
+            }
+            const Entry top = queue.top();
+            queue.pop();
+            if (locked[top.item] || top.version != version[top.item]) {
+                continue;
+            }
+            const auto [delta, b] = state.best_move(top.item);
+            if (b == state.part[top.item]) {
+                // No move within the partition size bounds
+                continue;
+            }
+            if (!queue.empty() && -delta < queue.top().gain) {
+                // No longer the best candidate, try again later
+                queue.push({-delta, top.item, top.version});
+                continue;
+            }
+            moves.emplace_back(top.item, state.part[top.item]);
+            locked[top.item] = true;
+            state.apply_move(top.item, b, push);
+            cur_cost += delta;
+            if (cur_cost < best_cost) {
+                best_cost = cur_cost;
+                best_prefix = moves.size();
+            }
+        }
+
+        // Roll back to the best prefix
+        while (moves.size() > best_prefix) {
+            const auto [x, a] = moves.back();
+            moves.pop_back();
+            state.apply_move(x, a, [](size_t) {});
+        }
+        soln.item_to_partition = state.part;
+        cur_cost = instance.eval(soln);
+        spdlog::debug("fm pass {:02} cost: {:11.6f} -> {:11.6f} ({} moves)",
+                      pass, pass_start_cost, cur_cost, best_prefix);
+        if (stopped || control.reached_target(cur_cost)) {
+            spdlog::info("fm stopped early after {} passes", pass + 1);
+            break;
+        }
+        if (best_prefix == 0 || cur_cost >= pass_start_cost) {
+            break;
+        }
+        control.maybe_checkpoint([&] { return soln; });
+    }
+    sort_partitions_by_size(instance, soln);
     return soln;
-}
\ No newline at end of file
+}
+
+PartitionSoln optift::partition_refine_fm(const PartitionInstance &instance,
+                                          PartitionSoln soln,
+                                          const SolveControl &control) {
+    return visit_cost_model(instance, [&](const auto &cost) {
+        return refine_fm(instance, std::move(soln), control, cost);
+    });
+}
+
+/// Size repair for a cost model of type Cost, see
+/// \ref partition_repair_sizes.
+template <typename Cost>
+PartitionSoln repair_sizes(const PartitionInstance &instance,
+                           PartitionSoln soln, const Cost &cost) {
+    ItemMoveState state{instance, soln, cost};
+    const size_t n_parts = soln.n_partitions;
+    const auto &sizes = state.sizes;
+    const auto oversized = [&](size_t k) {
+        return sizes[k] > instance.max_partition_size;
+    };
+
+    // Items of oversized partitions by their cheapest move to a partition
+    // with room, validated lazily as in refine_fm
+    const auto best_shed = [&](size_t x) {
+        std::pair best{std::numeric_limits<double>::infinity(), state.part[x]};
+        for (size_t b = 0; b < n_parts; b++) {
+            if (b != state.part[x] && !oversized(b) &&
+                sizes[b] + instance.item_sizes[x] <=
+                    instance.max_partition_size &&
+                state.allows_move(x, b)) {
+                best = std::min(best, std::pair{state.move_delta(x, b), b});
+            }
+        }
+        return best;
+    };
+    struct Entry {
+        double gain;
+        size_t item;
+        size_t version;
+
+        bool operator<(const Entry &other) const {
+            return std::tie(gain, other.item) < std::tie(other.gain, item);
+        }
+    };
+    std::vector<size_t> version(instance.n_items, 0);
+    std::priority_queue<Entry> queue;
+    const auto push = [&](size_t x) {
+        if (oversized(state.part[x])) {
+            queue.push({-best_shed(x).first, x, ++version[x]});
+        }
+    };
+    for (size_t x = 0; x < instance.n_items; x++) {
+        push(x);
+    }
+    while (!queue.empty()) {
+        const Entry top = queue.top();
+        queue.pop();
+        if (top.version != version[top.item] ||
+            !oversized(state.part[top.item])) {
+            continue;
+        }
+        const auto [delta, b] = best_shed(top.item);
+        if (b == state.part[top.item]) {
+            // Nowhere to go, but later moves may make room
+            continue;
+        }
+        if (!queue.empty() && -delta < queue.top().gain) {
+            queue.push({-delta, top.item, top.version});
+            continue;
+        }
+        state.apply_move(top.item, b, push);
+    }
+
+    // Undersized partitions, smallest first, are either merged into another
+    // partition or filled up with items of partitions that can spare them,
+    // whichever is cheaper. Both are tried by making the moves and undoing
+    // them.
+    const auto undo = [&](std::span<const std::pair<size_t, size_t>> moves) {
+        for (const auto &[x, from] : moves | ranges::views::reverse) {
+            state.apply_move(x, from, [](size_t) {});
+        }
+    };
+    std::vector<bool> given_up(n_parts, false);
+    for (;;) {
+        size_t a = n_parts;
+        for (size_t k = 0; k < n_parts; k++) {
+            if (!given_up[k] && sizes[k] > 0 &&
+                sizes[k] < instance.min_partition_size &&
+                (a == n_parts || sizes[k] < sizes[a])) {
+                a = k;
+            }
+        }
+        if (a == n_parts) {
+            break;
+        }
+        // Moves as (item, source partition)
+        std::vector<std::pair<size_t, size_t>> best_moves;
+        double best_delta = std::numeric_limits<double>::infinity();
+        std::vector<std::pair<size_t, size_t>> moves;
+
+        std::vector<size_t> items;
+        for (size_t x = 0; x < instance.n_items; x++) {
+            if (state.part[x] == a) {
+                items.push_back(x);
+            }
+        }
+        for (size_t b = 0; b < n_parts; b++) {
+            if (b == a || sizes[b] == 0 ||
+                sizes[a] + sizes[b] > instance.max_partition_size) {
+                continue;
+            }
+            moves.clear();
+            double delta = 0.0;
+            for (const size_t x : items) {
+                delta += state.move_delta(x, b);
+                moves.emplace_back(x, a);
+                state.apply_move(x, b, [](size_t) {});
+            }
+            undo(moves);
+            if (delta < best_delta) {
+                best_delta = delta;
+                best_moves = moves;
+                for (auto &[x, target] : best_moves) {
+                    target = b;
+                }
+            }
+        }
+
+        moves.clear();
+        double delta = 0.0;
+        while (sizes[a] < instance.min_partition_size) {
+            std::pair best{std::numeric_limits<double>::infinity(),
+                           instance.n_items};
+            for (size_t x = 0; x < instance.n_items; x++) {
+                const size_t k = state.part[x];
+                const size_t size = instance.item_sizes[x];
+                if (k != a &&
+                    sizes[k] - size >= instance.min_partition_size &&
+                    sizes[a] + size <= instance.max_partition_size) {
+                    best = std::min(best, std::pair{state.move_delta(x, a), x});
+                }
+            }
+            if (best.second == instance.n_items) {
+                delta = std::numeric_limits<double>::infinity();
+                break;
+            }
+            delta += best.first;
+            moves.emplace_back(best.second, state.part[best.second]);
+            state.apply_move(best.second, a, [](size_t) {});
+        }
+        undo(moves);
+        if (delta < best_delta) {
+            best_delta = delta;
+            best_moves = std::move(moves);
+            for (auto &[x, target] : best_moves) {
+                target = a;
+            }
+        }
+
+        if (best_moves.empty()) {
+            given_up[a] = true;
+            continue;
+        }
+        for (const auto &[x, target] : best_moves) {
+            state.apply_move(x, target, [](size_t) {});
+        }
+    }
+
+    soln.item_to_partition = state.part;
+    const size_t n_violating = static_cast<size_t>(std::ranges::count_if(
+        sizes, [&](size_t size) { return instance.size_violation(size) > 0; }));
+    if (n_violating > 0) {
+        spdlog::warn("{} partitions remain outside the size bounds",
+                     n_violating);
+    }
+    return soln;
+}
+
+PartitionSoln optift::partition_repair_sizes(const PartitionInstance &instance,
+                                             PartitionSoln soln) {
+    if (!instance.has_size_bounds()) {
+        return soln;
+    }
+    return visit_cost_model(instance, [&](const auto &cost) {
+        return repair_sizes(instance, std::move(soln), cost);
+    });
+}
+
+PartitionSoln optift::partition_split(const PartitionInstance &instance,
+                                      const PartitionSoln &soln) {
+    if (instance.n_partitions != soln.n_partitions + 1) {
+        throw std::runtime_error(fmt::format(
+            "cannot split {} partitions into {}", soln.n_partitions,
+            instance.n_partitions));
+    }
+    // Total weight of requests using each item
+    std::vector<double> frequency(instance.n_items, 0.0);
+    for (size_t x = 0; x < instance.n_items; x++) {
+        for (const size_t u : instance.item_requests.row(x)) {
+            frequency[x] += instance.weights[u];
+        }
+    }
+
+    PartitionSoln best{instance.n_partitions, soln.item_to_partition};
+    double best_cost = instance.eval(best);
+    for (auto &items : soln.partitions()) {
+        if (items.size() < 2) {
+            continue;
+        }
+        ranges::stable_sort(items, std::less<>{},
+                            [&](size_t x) { return frequency[x]; });
+        PartitionSoln candidate{instance.n_partitions,
+                                soln.item_to_partition};
+        for (size_t k = 0; k < items.size() / 2; k++) {
+            candidate.item_to_partition[items[k]] = soln.n_partitions;
+        }
+        if (const double cost = instance.eval(candidate); cost < best_cost) {
+            best_cost = cost;
+            best = std::move(candidate);
+        }
+    }
+    return best;
+}
+
+std::vector<PartitionSweepPoint>
+optift::partition_sweep(const PartitionInstance &instance,
+                        size_t max_partitions, const SolveControl &control) {
+    std::vector<PartitionSweepPoint> sweep;
+    PartitionInstance sub_instance = instance;
+    for (size_t k = instance.n_partitions; k <= max_partitions; k++) {
+        sub_instance.n_partitions = k;
+        PartitionSoln initial_soln =
+            sweep.empty() ? partition_solve_greedy(sub_instance)
+                          : partition_split(sub_instance, sweep.back().soln);
+        PartitionSoln soln = partition_repair_sizes(
+            sub_instance,
+            partition_refine_fm(sub_instance,
+                                partition_solve_heuristic(
+                                    sub_instance, std::move(initial_soln),
+                                    control),
+                                control));
+        const double cost = sub_instance.eval(soln);
+        spdlog::info("{:3} partitions: cost {}", k, cost);
+        sweep.push_back({k, cost, std::move(soln)});
+        if (control.should_stop()) {
+            break;
+        }
+    }
+    return sweep;
+}
+
+size_t
+optift::partition_sweep_select(std::span<const PartitionSweepPoint> sweep,
+                               std::optional<double> tolerance) {
+    if (sweep.empty()) {
+        throw std::invalid_argument("empty sweep");
+    }
+    const auto by_cost = [](const auto &point) { return point.cost; };
+    const double min_cost =
+        ranges::min(sweep | ranges::views::transform(by_cost));
+    const double max_cost =
+        ranges::max(sweep | ranges::views::transform(by_cost));
+    if (tolerance.has_value()) {
+        for (size_t i = 0; i < sweep.size(); i++) {
+            if (sweep[i].cost <= min_cost * (1.0 + *tolerance)) {
+                return i;
+            }
+        }
+    }
+    if (sweep.size() < 3 || max_cost == min_cost) {
+        return static_cast<size_t>(
+            ranges::min_element(sweep, std::less<>{}, by_cost) -
+            sweep.begin());
+    }
+    // Kneedle: normalize both axes to [0, 1] and find the point farthest below
+    // the chord between the two ends
+    const double x_first = static_cast<double>(sweep.front().n_partitions);
+    const double x_range =
+        static_cast<double>(sweep.back().n_partitions) - x_first;
+    const auto normalized = [&](size_t i) {
+        return std::pair{
+            (static_cast<double>(sweep[i].n_partitions) - x_first) / x_range,
+            (sweep[i].cost - min_cost) / (max_cost - min_cost)};
+    };
+    const auto [x0, y0] = normalized(0);
+    const auto [x1, y1] = normalized(sweep.size() - 1);
+    size_t knee = 0;
+    double knee_depth = 0.0;
+    for (size_t i = 1; i + 1 < sweep.size(); i++) {
+        const auto [x, y] = normalized(i);
+        const double chord = y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+        if (chord - y > knee_depth) {
+            knee_depth = chord - y;
+            knee = i;
+        }
+    }
+    return knee;
+}